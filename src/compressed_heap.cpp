@@ -0,0 +1,137 @@
+#include "compressed_heap.h"
+#include <algorithm>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static size_t RoundUp(size_t bytes) {
+    return bytes ? (bytes + 7) & ~size_t{7} : 8;
+}
+
+// Never destroyed: collector singletons may still release objects into it during static destruction.
+CompressedHeap &CompressedHeap::Instance() {
+    static auto *instance = new CompressedHeap();
+    return *instance;
+}
+
+// Only address space is reserved here. It stays PROT_NONE until Commit opens it up below top_, so
+// strict overcommit accounting only charges what is in use, and accesses past it fault.
+CompressedHeap::CompressedHeap()
+        : page_size_(static_cast<size_t>(sysconf(_SC_PAGESIZE))), small_free_(kSmallWords + 1) {
+    void *base = mmap(nullptr, kReservedBytes, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    base_ = static_cast<char *>(base);
+}
+
+// Blocks up to kSmallWords words are recycled through exact-size free lists. Larger ones take the
+// smallest free run that fits and return the rest of it to the free runs. Everything else is
+// carved from the top of the range. Memory is handed out uninitialized: allocate_shared
+// constructs the objects and value-initializes the payload arrays placed in it.
+void *CompressedHeap::Allocate(size_t bytes) {
+    bytes = RoundUp(bytes);
+    size_t words = bytes / 8;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (words <= kSmallWords) {
+        auto &free_list = small_free_[words];
+        if (!free_list.empty()) {
+            void *ptr = free_list.back();
+            free_list.pop_back();
+            return ptr;
+        }
+    } else {
+        auto it = free_by_size_.lower_bound({bytes, 0});
+        if (it != free_by_size_.end()) {
+            auto [run_bytes, offset] = *it;
+            EraseFree(offset, run_bytes);
+            if (run_bytes > bytes) {
+                InsertFree(offset + bytes, run_bytes - bytes);
+            }
+            return base_ + offset;
+        }
+    }
+    if (top_ + bytes > kReservedBytes) {
+        throw std::bad_alloc();
+    }
+    if (top_ + bytes > committed_top_) {
+        Commit(top_ + bytes);
+    }
+    void *ptr = base_ + top_;
+    top_ += bytes;
+    touched_top_ = std::max(touched_top_, top_);
+    return ptr;
+}
+
+// Large blocks are merged with the free runs next to them, and a run that reaches top_ is handed
+// back to the top of the range. Their pages stay committed until Trim.
+void CompressedHeap::Deallocate(void *ptr, size_t bytes) {
+    bytes = RoundUp(bytes);
+    size_t words = bytes / 8;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (words <= kSmallWords) {
+        small_free_[words].push_back(ptr);
+        return;
+    }
+    size_t offset = static_cast<char *>(ptr) - base_;
+    auto next = free_by_offset_.find(offset + bytes);
+    if (next != free_by_offset_.end()) {
+        size_t next_bytes = next->second;
+        EraseFree(offset + bytes, next_bytes);
+        bytes += next_bytes;
+    }
+    auto prev = free_by_offset_.lower_bound(offset);
+    if (prev != free_by_offset_.begin() && (--prev)->first + prev->second == offset) {
+        auto [prev_offset, prev_bytes] = *prev;
+        EraseFree(prev_offset, prev_bytes);
+        offset = prev_offset;
+        bytes += prev_bytes;
+    }
+    if (offset + bytes == top_) {
+        top_ = offset;
+    } else {
+        InsertFree(offset, bytes);
+    }
+}
+
+// Gives the pages of free runs and of the range above top_ back to the kernel; they read back as
+// zeros when touched again.
+void CompressedHeap::Trim() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &[offset, bytes]: free_by_offset_) {
+        Release(offset, bytes);
+    }
+    Release(top_, touched_top_ - top_);
+    touched_top_ = top_;
+}
+
+void CompressedHeap::InsertFree(size_t offset, size_t bytes) {
+    free_by_size_.insert({bytes, offset});
+    free_by_offset_.insert({offset, bytes});
+}
+
+void CompressedHeap::EraseFree(size_t offset, size_t bytes) {
+    free_by_size_.erase({bytes, offset});
+    free_by_offset_.erase(offset);
+}
+
+// Makes the range read/write up to at least top. Committed pages keep their protection after Trim,
+// which only drops their contents.
+void CompressedHeap::Commit(size_t top) {
+    size_t end = std::max(top, committed_top_ + kCommitBytes);
+    end = std::min((end + page_size_ - 1) / page_size_ * page_size_, kReservedBytes);
+    if (mprotect(base_ + committed_top_, end - committed_top_, PROT_READ | PROT_WRITE) != 0) {
+        throw std::bad_alloc();
+    }
+    committed_top_ = end;
+}
+
+// Only pages lying entirely inside the run are released.
+void CompressedHeap::Release(size_t offset, size_t bytes) {
+    size_t begin = (offset + page_size_ - 1) / page_size_ * page_size_;
+    size_t end = (offset + bytes) / page_size_ * page_size_;
+    if (begin < end) {
+        madvise(base_ + begin, end - begin, MADV_DONTNEED);
+    }
+}
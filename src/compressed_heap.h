@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <utility>
+#include <vector>
+
+// One contiguous, lazily committed virtual range holding collector metadata and payloads, so
+// that references into it fit in 32 bits: a reference is the offset from the base in 8-byte
+// words, and 0 stands for null.
+class CompressedHeap {
+public:
+    static constexpr size_t kReservedBytes = size_t{1} << 35;
+
+    static CompressedHeap &Instance();
+
+    CompressedHeap(const CompressedHeap &) = delete;
+
+    CompressedHeap &operator=(const CompressedHeap &) = delete;
+
+    void *Allocate(size_t bytes);
+
+    void Deallocate(void *ptr, size_t bytes);
+
+    void Trim();
+
+    static uint32_t Compress(const void *ptr) {
+        if (!ptr) {
+            return 0;
+        }
+        return static_cast<uint32_t>((static_cast<const char *>(ptr) - base_) >> 3);
+    }
+
+    static void *Decompress(uint32_t ref) {
+        if (!ref) {
+            return nullptr;
+        }
+        return base_ + (static_cast<size_t>(ref) << 3);
+    }
+
+private:
+    static constexpr size_t kSmallWords = 64;
+    // The range is made accessible in steps of at least this many bytes as top_ grows.
+    static constexpr size_t kCommitBytes = size_t{1} << 20;
+
+    CompressedHeap();
+
+    void InsertFree(size_t offset, size_t bytes);
+
+    void EraseFree(size_t offset, size_t bytes);
+
+    void Release(size_t offset, size_t bytes);
+
+    void Commit(size_t top);
+
+    static inline char *base_ = nullptr;
+
+    std::mutex mutex_;
+    size_t page_size_;
+    size_t top_ = 8;
+    // Highest top_ since the last Trim; pages between top_ and it may still be committed.
+    size_t touched_top_ = 8;
+    // End of the read/write part of the range; the rest is PROT_NONE.
+    size_t committed_top_ = 0;
+    std::vector<std::vector<void *>> small_free_;
+    // Free runs of large blocks, by (size, offset) for best fit and by offset for merging neighbours.
+    std::set<std::pair<size_t, size_t>> free_by_size_;
+    std::map<size_t, size_t> free_by_offset_;
+};
+
+template<typename T>
+struct CompressedHeapAllocator {
+    using value_type = T;
+
+    CompressedHeapAllocator() = default;
+
+    template<typename U>
+    CompressedHeapAllocator(const CompressedHeapAllocator<U> &) {
+    }
+
+    T *allocate(size_t n) {
+        return static_cast<T *>(CompressedHeap::Instance().Allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T *ptr, size_t n) {
+        CompressedHeap::Instance().Deallocate(ptr, n * sizeof(T));
+    }
+
+    template<typename U>
+    bool operator==(const CompressedHeapAllocator<U> &) const {
+        return true;
+    }
+};
@@ -1,8 +1,16 @@
 #include "gc.h"
 #include <gc_impl.h>
 
-GenerationalGC& gc() {
-    return GenerationalGC::GetInstance();
+#ifdef GC_SINGLE_THREADED
+using DefaultGC = GenerationalGC<SingleThreadedPolicy>;
+#elif defined(GC_LOCKED)
+using DefaultGC = GenerationalGC<LockedPolicy>;
+#else
+using DefaultGC = GenerationalGC<ConcurrentPolicy>;
+#endif
+
+DefaultGC& gc() {
+    return DefaultGC::GetInstance();
 }
 
 void* gc_malloc(size_t size, bool is_root, void* parent) {
@@ -17,15 +25,92 @@ void gc_collect(bool major) {
     gc().ForceGarbageCollection(major);
 }
 
+size_t gc_collect_async(bool major) {
+    return gc().RequestCollection(major);
+}
+
+void gc_collect_wait(size_t ticket) {
+    gc().WaitForCollection(ticket);
+}
+
+bool gc_collect_done(size_t ticket) {
+    return gc().IsCollectionDone(ticket);
+}
+
 void change_parent(void* ptr, void* new_parent_ptr) {
     gc().ChangeParent(ptr, new_parent_ptr);
 }
 
+void gc_region_begin() {
+    gc().RegionBegin();
+}
+
+void gc_region_end() {
+    gc().RegionEnd();
+}
+
+bool gc_snapshot_save(const char* path) {
+    return gc().SaveSnapshot(path);
+}
+
+bool gc_snapshot_load(const char* path) {
+    return gc().LoadSnapshot(path);
+}
+
+size_t gc_snapshot_roots(void** roots, size_t max_roots) {
+    return gc().GetSnapshotRoots(roots, max_roots);
+}
+
+void configure_memory_pressure(const char* cgroup_dir, size_t min_headroom, double max_pressure) {
+    gc().ConfigureMemoryPressure(cgroup_dir, min_headroom, max_pressure);
+}
+
+WeakRef* gc_weak_ref_create(void* ptr) {
+    return gc().CreateWeakRef(ptr);
+}
+
+void* gc_weak_ref_get(WeakRef* ref) {
+    return gc().GetWeakRef(ref);
+}
+
+void gc_weak_ref_free(WeakRef* ref) {
+    gc().FreeWeakRef(ref);
+}
+
+WeakMap* gc_weak_map_create() {
+    return gc().CreateWeakMap();
+}
+
+void gc_weak_map_set(WeakMap* map, void* key, void* value) {
+    gc().WeakMapSet(map, key, value);
+}
+
+void* gc_weak_map_get(WeakMap* map, void* key) {
+    return gc().WeakMapGet(map, key);
+}
+
+void gc_weak_map_remove(WeakMap* map, void* key) {
+    gc().WeakMapRemove(map, key);
+}
+
+size_t gc_weak_map_size(WeakMap* map) {
+    return gc().WeakMapSize(map);
+}
+
+void gc_weak_map_free(WeakMap* map) {
+    gc().FreeWeakMap(map);
+}
+
 void configure_thresholds(size_t young_threshold, size_t old_threshold,
                           double young_ratio, double old_ratio) {
     gc().ConfigureThresholds(young_threshold, old_threshold, young_ratio, old_ratio);
 }
 
+void configure_adaptive_young_gen(bool enabled, size_t min_young_threshold, size_t max_young_threshold,
+                                  double target_pause_ms, double target_gc_cpu_fraction) {
+    gc().ConfigureAdaptiveYoungGen(enabled, min_young_threshold, max_young_threshold,
+                                   target_pause_ms, target_gc_cpu_fraction);
+}
 
 size_t get_collections_count() {
     return gc().GetCollectionsCount();
@@ -36,4 +121,36 @@ size_t get_old_gen_size() {
 }
 size_t get_young_gen_size() {
     return gc().GetYoungGenSize();
+}
+
+size_t get_snapshot_size() {
+    return gc().GetSnapshotSize();
+}
+
+size_t get_memory_headroom() {
+    return gc().GetMemoryHeadroom();
+}
+
+size_t get_memory_pressure_collections() {
+    return gc().GetMemoryPressureCollections();
+}
+
+size_t get_young_gen_threshold() {
+    return gc().GetYoungGenThreshold();
+}
+
+double get_young_gen_survival_rate() {
+    return gc().GetYoungGenSurvivalRate();
+}
+
+double get_last_minor_pause_ms() {
+    return gc().GetLastMinorPauseMs();
+}
+
+double get_last_mark_ms() {
+    return gc().GetLastMarkMs();
+}
+
+double get_allocation_rate() {
+    return gc().GetAllocationRate();
 }
\ No newline at end of file
@@ -8,11 +8,84 @@ void gc_free(void* ptr);
 
 void gc_collect(bool major);
 
+// Hands a collection to the background thread and returns a ticket without waiting. Requests
+// made before the next cycle starts are served by that one cycle, which is major if any of
+// them asked for a major collection.
+size_t gc_collect_async(bool major);
+
+// Blocks until a cycle that started after the matching gc_collect_async call has finished.
+void gc_collect_wait(size_t ticket);
+
+bool gc_collect_done(size_t ticket);
+
 void configure_thresholds(size_t young_threshold, size_t old_threshold,
                           double young_ratio, double old_ratio);
 
 void change_parent(void* ptr, void* new_parent_ptr);
 
+// Objects allocated by the calling thread between gc_region_begin and gc_region_end are placed
+// in a bump-allocated arena and released together at gc_region_end, without tracing or sweeping.
+// Objects that are still roots or were linked from outside the region survive it.
+void gc_region_begin();
+void gc_region_end();
+
+class GCRegionScope {
+public:
+    GCRegionScope() {
+        gc_region_begin();
+    }
+
+    ~GCRegionScope() {
+        gc_region_end();
+    }
+
+    GCRegionScope(const GCRegionScope &) = delete;
+
+    GCRegionScope &operator=(const GCRegionScope &) = delete;
+};
+
+// Writes the old generation (payloads, sizes, edges and root flags) to path. Payload words that
+// hold the address of another saved object are rewritten to point at its copy on load. The file
+// is written to path + ".tmp" and renamed over path, so a failed save keeps the previous file.
+bool gc_snapshot_save(const char* path);
+// Maps a snapshot back in. Its objects are permanently live and are never traced or swept.
+bool gc_snapshot_load(const char* path);
+// Copies up to max_roots loaded root objects to roots and returns how many there are.
+size_t gc_snapshot_roots(void** roots, size_t max_roots);
+
+// Watches the cgroup v2 memory controller in cgroup_dir (for example "/sys/fs/cgroup").
+// Once less than min_headroom bytes are left below memory.max, or the "some avg10" stall
+// percentage in memory.pressure exceeds max_pressure (0 disables the PSI check), the collector
+// tightens its thresholds, runs a major collection and returns freed memory to the system.
+// While the pressure lasts, another collection only runs once the heap has grown or headroom
+// has dropped, and at most once every three seconds. The thresholds are relaxed again gradually once the pressure is gone. Passing NULL as cgroup_dir turns the monitor off.
+void configure_memory_pressure(const char* cgroup_dir, size_t min_headroom, double max_pressure);
+
+struct WeakRef;
+struct WeakMap;
+
+WeakRef* gc_weak_ref_create(void* ptr);
+void* gc_weak_ref_get(WeakRef* ref);
+void gc_weak_ref_free(WeakRef* ref);
+
+WeakMap* gc_weak_map_create();
+void gc_weak_map_set(WeakMap* map, void* key, void* value);
+void* gc_weak_map_get(WeakMap* map, void* key);
+void gc_weak_map_remove(WeakMap* map, void* key);
+size_t gc_weak_map_size(WeakMap* map);
+void gc_weak_map_free(WeakMap* map);
+
+void configure_adaptive_young_gen(bool enabled, size_t min_young_threshold, size_t max_young_threshold,
+                                  double target_pause_ms, double target_gc_cpu_fraction);
+
 size_t get_collections_count();
 size_t get_young_gen_size();
-size_t get_old_gen_size();
\ No newline at end of file
+size_t get_old_gen_size();
+size_t get_snapshot_size();
+size_t get_memory_headroom();
+size_t get_memory_pressure_collections();
+size_t get_young_gen_threshold();
+double get_young_gen_survival_rate();
+double get_last_minor_pause_ms();
+double get_last_mark_ms();
+double get_allocation_rate();
\ No newline at end of file
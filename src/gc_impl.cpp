@@ -3,37 +3,110 @@
 #include <iostream>
 #include <mutex>
 #include <vector>
+#include <algorithm>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
 constexpr int TIME_TO_CHECK = 1000;
+constexpr size_t PRESSURE_POLL_ALLOCATIONS = 4096;
+constexpr int PRESSURE_COLLECTION_INTERVAL = 3 * TIME_TO_CHECK;
+constexpr size_t REGION_CHUNK_WORDS = 8 * 1024;
+constexpr size_t MARK_PREFETCH_DISTANCE = 8;
+constexpr size_t MARK_QUEUE_COMPACT_MIN = 4096;
+constexpr size_t MARK_QUEUE_RETAINED_CAPACITY = 64 * 1024;
 
 GCObject::GCObject(bool is_root_value, size_t size)
-        : is_root(is_root_value), memory(std::make_unique<uint64_t[]>(size / 8 + 1)) {
+        : is_root(is_root_value), memory(AllocatePayload(size / 8 + 1)) {
+}
+
+GCObject::GCObject(bool is_root_value, std::shared_ptr<uint64_t[]> memory_value)
+        : is_root(is_root_value), memory(std::move(memory_value)) {
+}
+
+// With GC_COMPRESSED_REFS both the object, together with its shared_ptr control block, and its
+// payload are carved from the CompressedHeap range, so that ToRef can encode it in 32 bits.
+std::shared_ptr<GCObject> MakeObject(bool is_root, size_t size) {
+#ifdef GC_COMPRESSED_REFS
+    return std::allocate_shared<GCObject>(CompressedHeapAllocator<GCObject>(), is_root, size);
+#else
+    return std::make_shared<GCObject>(is_root, size);
+#endif
+}
+
+std::shared_ptr<GCObject> MakeObject(bool is_root, std::shared_ptr<uint64_t[]> memory) {
+#ifdef GC_COMPRESSED_REFS
+    return std::allocate_shared<GCObject>(CompressedHeapAllocator<GCObject>(), is_root, std::move(memory));
+#else
+    return std::make_shared<GCObject>(is_root, std::move(memory));
+#endif
+}
+
+std::shared_ptr<uint64_t[]> AllocatePayload(size_t words) {
+#ifdef GC_COMPRESSED_REFS
+    return std::allocate_shared<uint64_t[]>(CompressedHeapAllocator<uint64_t>(), words);
+#else
+    return std::make_shared<uint64_t[]>(words);
+#endif
+}
+
+// Objects share ownership of the chunk they were carved from, so a chunk is released as soon as
+// the region drops its objects, or later if one of them escaped.
+std::shared_ptr<uint64_t[]> Region::Allocate(size_t size) {
+    size_t words = size / 8 + 1;
+    if (words > REGION_CHUNK_WORDS) {
+        return AllocatePayload(words);
+    }
+    if (!chunk || chunk_offset + words > REGION_CHUNK_WORDS) {
+        chunk = AllocatePayload(REGION_CHUNK_WORDS);
+        chunk_offset = 0;
+    }
+    std::shared_ptr<uint64_t[]> memory(chunk, chunk.get() + chunk_offset);
+    chunk_offset += words;
+    return memory;
 }
 
 void GCObject::AddEdge(const std::shared_ptr<GCObject> &obj) {
-    std::unique_lock<std::mutex> lock(edges_mutex);
-    edges.insert(obj->memory.get());
+    obj->edge_index = static_cast<uint32_t>(edges.size());
+    edges.push_back(ToRef(obj.get()));
 }
 
+// The last edge moves into the freed slot. The search is only a fallback for snapshot files
+// whose edge lists disagree with the parents they record.
 void GCObject::RemEdge(const std::shared_ptr<GCObject> &obj) {
-    std::unique_lock lock(edges_mutex);
-    edges.erase(obj->memory.get());
+    ObjectRef ref = ToRef(obj.get());
+    size_t index = obj->edge_index;
+    if (index >= edges.size() || edges[index] != ref) {
+        index = std::find(edges.begin(), edges.end(), ref) - edges.begin();
+        if (index == edges.size()) {
+            return;
+        }
+    }
+    edges[index] = edges.back();
+    FromRef(edges[index])->edge_index = static_cast<uint32_t>(index);
+    edges.pop_back();
 }
 
-GenerationalGC::GenerationalGC() {
-    StartGCThread();
+template<typename Policy>
+GenerationalGC<Policy>::GenerationalGC() {
+    if constexpr (Policy::kTrigger == GCTrigger::kBackground) {
+        StartGCThread();
+    }
 }
 
-GenerationalGC::~GenerationalGC() {
+template<typename Policy>
+GenerationalGC<Policy>::~GenerationalGC() {
     StopGCThread();
 }
 
-void GenerationalGC::StartGCThread() {
+template<typename Policy>
+void GenerationalGC<Policy>::StartGCThread() {
     should_stop_.store(false);
     gc_thread_ = std::thread(&GenerationalGC::GCThreadFunction, this);
 }
 
-void GenerationalGC::StopGCThread() {
+template<typename Policy>
+void GenerationalGC<Policy>::StopGCThread() {
     should_stop_.store(true);
     gc_cv_.notify_one();
     if (gc_thread_.joinable()) {
@@ -41,46 +114,171 @@ void GenerationalGC::StopGCThread() {
     }
 }
 
-void GenerationalGC::ForceGarbageCollection(bool major) {
+template<typename Policy>
+void GenerationalGC<Policy>::ForceGarbageCollection(bool major) {
+    Collect(major);
+}
+
+template<typename Policy>
+size_t GenerationalGC<Policy>::RequestCollection(bool major) {
+    if constexpr (Policy::kTrigger == GCTrigger::kInline) {
+        return Collect(major);
+    }
+    size_t ticket;
+    {
+        std::lock_guard<Mutex> lock(background_mutex_);
+        collection_requested_ = true;
+        major_requested_ = major_requested_ || major;
+        ticket = cycles_started_ + 1;
+    }
+    gc_cv_.notify_one();
+    return ticket;
+}
+
+template<typename Policy>
+void GenerationalGC<Policy>::WaitForCollection(size_t ticket) {
+    std::unique_lock<Mutex> lock(background_mutex_);
+    cycle_done_cv_.wait(lock, [this, ticket] {
+        return cycles_completed_ >= ticket;
+    });
+}
+
+template<typename Policy>
+bool GenerationalGC<Policy>::IsCollectionDone(size_t ticket) {
+    std::lock_guard<Mutex> lock(background_mutex_);
+    return cycles_completed_ >= ticket;
+}
+
+// Cycles run one at a time. Each cycle takes over the requests made before it started, so it
+// is promoted to a major collection if any of them asked for one.
+template<typename Policy>
+size_t GenerationalGC<Policy>::Collect(bool major) {
+    std::lock_guard<Mutex> cycle_lock(cycle_mutex_);
+    size_t cycle;
+    {
+        std::lock_guard<Mutex> lock(background_mutex_);
+        major = major || major_requested_;
+        collection_requested_ = false;
+        major_requested_ = false;
+        cycle = ++cycles_started_;
+    }
+
+    gc_in_progress_.store(true);
     if (major) {
-        MajorCollect();
+        CollectFull();
+    } else {
+        CollectYoung();
+    }
+    IncCollectionsCount();
+    gc_in_progress_.store(false);
+
+    {
+        std::lock_guard<Mutex> lock(background_mutex_);
+        cycles_completed_ = cycle;
+    }
+    if constexpr (Policy::kTrigger == GCTrigger::kBackground) {
+        cycle_done_cv_.notify_all();
+    }
+    return cycle;
+}
+
+// Periodic checks come from the background thread once per TIME_TO_CHECK and also run a major
+// collection every fifth cycle. Inline checks run on every allocation, so they only collect once
+// the young generation is full, and promote when the survivors of the previous minor collection
+// already take up half of it.
+template<typename Policy>
+void GenerationalGC<Policy>::CollectIfNeeded(bool periodic) {
+    double scale = pressure_scale_.load();
+    double young_limit = young_gen_ratio_ * scale * static_cast<double>(young_gen_threshold_);
+    bool young_gen_full = static_cast<double>(young_gen_size_.load()) >= young_limit;
+    bool old_gen_full = static_cast<double>(old_gen_size_.load()) >=
+                        old_gen_ratio_ * scale * static_cast<double>(old_gen_threshold_);
+    if (periodic) {
+        old_gen_full = old_gen_full || collections_count_.load() % 5 == 0;
     } else {
+        if (!young_gen_full || gc_in_progress_.load()) {
+            return;
+        }
+        old_gen_full = old_gen_full || static_cast<double>(young_gen_size_after_cycle_.load()) >= young_limit / 2;
+    }
+    if (old_gen_full) {
+        MajorCollect();
+    } else if (young_gen_full) {
         MinorCollect();
     }
 }
 
+// Inline triggering has no background tick, so allocations sample the cgroup files instead,
+// at most once per TIME_TO_CHECK.
+template<typename Policy>
+void GenerationalGC<Policy>::PollMemoryPressure() {
+    if (allocations_since_poll_.fetch_add(1) % PRESSURE_POLL_ALLOCATIONS != 0) {
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<Mutex> lock(pressure_mutex_);
+        if (now - last_poll_ < std::chrono::milliseconds(TIME_TO_CHECK)) {
+            return;
+        }
+        last_poll_ = now;
+    }
+    CheckMemoryPressure();
+}
+
 
-void GenerationalGC::GCThreadFunction() {
+// Requests can wake the thread more often than once per tick, so the cgroup is checked whenever
+// TIME_TO_CHECK has passed since the last check, whether or not a request was served in between.
+template<typename Policy>
+void GenerationalGC<Policy>::GCThreadFunction() {
+    auto last_tick = std::chrono::steady_clock::now();
     while (!should_stop_.load()) {
+        bool requested;
         {
-            std::unique_lock<std::mutex> lock(background_mutex_);
+            std::unique_lock<Mutex> lock(background_mutex_);
             gc_cv_.wait_for(lock, std::chrono::milliseconds(TIME_TO_CHECK), [this] {
-                return should_stop_.load();
+                return should_stop_.load() || collection_requested_;
             });
+            requested = collection_requested_;
         }
         if (should_stop_.load()) {
             break;
         }
-
-        bool young_gen_full = static_cast<double>(young_gen_size_.load()) >=
-                              young_gen_ratio_ * static_cast<double>(young_gen_threshold_);
-        bool old_gen_full = collections_count_.load() % 5 == 0 ||
-                            static_cast<double>(old_gen_size_.load()) >=
-                            old_gen_ratio_ * static_cast<double>(old_gen_threshold_);
-        if (old_gen_full) {
-            MajorCollect();
-        } else if (young_gen_full) {
-            MinorCollect();
+        if (requested) {
+            Collect(false);
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (requested && now - last_tick < std::chrono::milliseconds(TIME_TO_CHECK)) {
+            continue;
+        }
+        last_tick = now;
+        if (!CheckMemoryPressure() && !requested) {
+            CollectIfNeeded(true);
         }
     }
 }
 
-void *GenerationalGC::Malloc(size_t size, bool is_root, void *parent) {
-    auto obj = std::make_shared<GCObject>(is_root, size);
+template<typename Policy>
+void *GenerationalGC<Policy>::Malloc(size_t size, bool is_root, void *parent) {
+    if (regions_open_.load() > 0) {
+        std::lock_guard<Mutex> lock(gc_mutex_);
+        if (Region *region = CurrentRegion()) {
+            return RegionMalloc(region, size, is_root, parent);
+        }
+    }
+
+    // Collect before the object exists: it has no links yet, so a cycle would sweep it before the
+    // caller gets a chance to attach it.
+    if constexpr (Policy::kTrigger == GCTrigger::kInline) {
+        PollMemoryPressure();
+        CollectIfNeeded(false);
+    }
+
+    auto obj = MakeObject(is_root, size);
     void *ptr = obj->memory.get();
     obj->size = size;
     {
-        std::lock_guard<std::mutex> lock(gc_mutex_);
+        std::lock_guard<Mutex> lock(gc_mutex_);
         if (is_root) {
             young_roots_.insert({ptr, obj});
         }
@@ -91,7 +289,13 @@ void *GenerationalGC::Malloc(size_t size, bool is_root, void *parent) {
             } else {
                 if (old_gen_.contains(parent)) {
                     parent_obj = old_gen_[parent];
-                    young_from_old_.insert({ptr, obj});
+                    young_from_old_.insert(ToRef(obj.get()));
+                } else if (snapshot_gen_.contains(parent)) {
+                    parent_obj = snapshot_gen_[parent];
+                    snapshot_children_.insert(ToRef(obj.get()));
+                } else if (Region *parent_region = FindRegion(parent)) {
+                    parent_obj = parent_region->objects[parent];
+                    parent_region->outside_children.insert({ptr, obj});
                 }
             }
             if (parent_obj) {
@@ -103,32 +307,48 @@ void *GenerationalGC::Malloc(size_t size, bool is_root, void *parent) {
     }
 
     young_gen_size_ += size;
+    // The background thread only checks thresholds once per tick, which is too late while the
+    // cgroup is short on memory, so allocations past the tightened limit wake it up.
+    if constexpr (Policy::kTrigger == GCTrigger::kBackground) {
+        double scale = pressure_scale_.load();
+        if (scale < 1.0 && !gc_in_progress_.load() && static_cast<double>(young_gen_size_.load()) >=
+                young_gen_ratio_ * scale * static_cast<double>(young_gen_threshold_)) {
+            RequestCollection(false);
+        }
+    }
     return ptr;
 }
 
-void GenerationalGC::ChangeParent(void *ptr, void *new_parent) {
+template<typename Policy>
+void GenerationalGC<Policy>::ChangeParent(void *ptr, void *new_parent) {
     {
-        std::lock_guard<std::mutex> lock(gc_mutex_);
+        std::lock_guard<Mutex> lock(gc_mutex_);
 
-        std::shared_ptr<GCObject> obj = FindObject(ptr);
+        std::shared_ptr<GCObject> obj = FindAnyObject(ptr);
 
-        std::shared_ptr<GCObject> old_parent_obj = FindObject(obj->parent);
+        std::shared_ptr<GCObject> old_parent_obj = FindAnyObject(obj->parent);
         if (old_parent_obj) {
             old_parent_obj->RemEdge(obj);
+            if (old_parent_obj->permanent) {
+                snapshot_children_.erase(ToRef(obj.get()));
+            }
         }
 
-        std::shared_ptr<GCObject> new_parent_obj = FindObject(new_parent);
+        std::shared_ptr<GCObject> new_parent_obj = FindAnyObject(new_parent);
         new_parent_obj->AddEdge(obj);
 
         obj->parent = new_parent;
+        RememberOldParent(obj);
+        RememberRegionParent(ptr, obj);
     }
 }
 
-void GenerationalGC::Free(void *ptr) {
+template<typename Policy>
+void GenerationalGC<Policy>::Free(void *ptr) {
     try {
-        std::lock_guard<std::mutex> lock(gc_mutex_);
+        std::lock_guard<Mutex> lock(gc_mutex_);
 
-        std::shared_ptr<GCObject> obj = FindObject(ptr);
+        std::shared_ptr<GCObject> obj = FindAnyObject(ptr);
         if (obj) {
             obj->is_root = false;
             young_roots_.erase(ptr);
@@ -138,85 +358,337 @@ void GenerationalGC::Free(void *ptr) {
     }
 }
 
-size_t GenerationalGC::GetCollectionsCount() {
-    return collections_count_.load();
+template<typename Policy>
+WeakRef *GenerationalGC<Policy>::CreateWeakRef(void *ptr) {
+    auto ref = std::make_unique<WeakRef>();
+    WeakRef *handle = ref.get();
+    std::lock_guard<Mutex> lock(gc_mutex_);
+    if (FindAnyObject(ptr)) {
+        ref->target = ptr;
+        if (IsYoung(ptr)) {
+            young_weak_refs_.insert(handle);
+        }
+        if (Region *region = FindRegion(ptr)) {
+            region->weak_refs.insert(handle);
+        }
+    }
+    weak_refs_.insert({handle, std::move(ref)});
+    return handle;
 }
 
-size_t GenerationalGC::GetYoungGenSize() {
-    return young_gen_size_.load();
+template<typename Policy>
+void *GenerationalGC<Policy>::GetWeakRef(WeakRef *ref) {
+    std::lock_guard<Mutex> lock(gc_mutex_);
+    return ref->target;
 }
 
-size_t GenerationalGC::GetOldGenSize() {
-    return old_gen_size_.load();
+template<typename Policy>
+void GenerationalGC<Policy>::FreeWeakRef(WeakRef *ref) {
+    std::lock_guard<Mutex> lock(gc_mutex_);
+    if (Region *region = FindRegion(ref->target)) {
+        region->weak_refs.erase(ref);
+    }
+    young_weak_refs_.erase(ref);
+    weak_refs_.erase(ref);
 }
 
-void GenerationalGC::MinorCollect() {
-    bool expected = false;
-    if (!gc_in_progress_.compare_exchange_strong(expected, true)) {
-        return;
-    }
-    {
-        std::lock_guard<std::mutex> lock(gc_mutex_);
-        for (const auto &[ptr, obj]: young_roots_) {
-            Mark(obj);
+template<typename Policy>
+WeakMap *GenerationalGC<Policy>::CreateWeakMap() {
+    auto map = std::make_unique<WeakMap>();
+    WeakMap *handle = map.get();
+    std::lock_guard<Mutex> lock(gc_mutex_);
+    weak_maps_.insert({handle, std::move(map)});
+    return handle;
+}
+
+template<typename Policy>
+void GenerationalGC<Policy>::WeakMapSet(WeakMap *map, void *key, void *value) {
+    std::lock_guard<Mutex> lock(gc_mutex_);
+    if (FindAnyObject(key)) {
+        map->entries[key] = value;
+        if (IsYoung(key) || IsYoung(value)) {
+            young_weak_entries_.insert({map, key});
         }
-        for (const auto &[ptr, obj]: young_from_old_) {
-            Mark(obj);
+        RememberRegionWeakEntry(map, key);
+    }
+}
+
+template<typename Policy>
+void *GenerationalGC<Policy>::WeakMapGet(WeakMap *map, void *key) {
+    std::lock_guard<Mutex> lock(gc_mutex_);
+    auto it = map->entries.find(key);
+    return it == map->entries.end() ? nullptr : it->second;
+}
+
+template<typename Policy>
+void GenerationalGC<Policy>::WeakMapRemove(WeakMap *map, void *key) {
+    std::lock_guard<Mutex> lock(gc_mutex_);
+    for (const auto &[thread_id, stack]: regions_) {
+        for (const auto &region: stack) {
+            region->weak_entries.erase({map, key});
         }
+    }
+    young_weak_entries_.erase({map, key});
+    map->entries.erase(key);
+}
 
-        Sweep(young_gen_);
-        young_gen_size_ = 0;
-        for (const auto &[ptr, obj]: young_gen_) {
-            young_gen_size_ += obj->size;
+template<typename Policy>
+size_t GenerationalGC<Policy>::WeakMapSize(WeakMap *map) {
+    std::lock_guard<Mutex> lock(gc_mutex_);
+    return map->entries.size();
+}
+
+template<typename Policy>
+void GenerationalGC<Policy>::FreeWeakMap(WeakMap *map) {
+    std::lock_guard<Mutex> lock(gc_mutex_);
+    auto in_map = [map](const WeakEntry &entry) {
+        return entry.first == map;
+    };
+    for (const auto &[thread_id, stack]: regions_) {
+        for (const auto &region: stack) {
+            std::erase_if(region->weak_entries, in_map);
         }
     }
+    std::erase_if(young_weak_entries_, in_map);
+    weak_maps_.erase(map);
+}
 
-    IncCollectionsCount();
-    gc_in_progress_.store(false);
+template<typename Policy>
+void GenerationalGC<Policy>::RegionBegin() {
+    std::lock_guard<Mutex> lock(gc_mutex_);
+    regions_[std::this_thread::get_id()].push_back(std::make_unique<Region>());
+    regions_open_ += 1;
 }
 
-void GenerationalGC::MajorCollect() {
-    bool expected = false;
-    if (!gc_in_progress_.compare_exchange_strong(expected, true)) {
-        return;
+// Escaped objects are the ones still rooted, linked from outside the region, held as a weak map
+// value under a key that outlives the region, or reachable from any of those. They keep their
+// address and move to the enclosing region, or to the young generation when there is none.
+template<typename Policy>
+void GenerationalGC<Policy>::RegionEnd() {
+    std::lock_guard<Mutex> lock(gc_mutex_);
+    auto stack_it = regions_.find(std::this_thread::get_id());
+    if (stack_it == regions_.end()) {
+        throw std::logic_error("gc_region_end called without a matching gc_region_begin");
     }
-    {
-        std::lock_guard<std::mutex> lock(gc_mutex_);
-        for (const auto &[ptr, obj]: old_roots_) {
-            Mark(obj);
+    std::unique_ptr<Region> region = std::move(stack_it->second.back());
+    stack_it->second.pop_back();
+    if (stack_it->second.empty()) {
+        regions_.erase(stack_it);
+    }
+    regions_open_ -= 1;
+
+    std::unordered_map<void *, std::shared_ptr<GCObject>> escaped;
+    std::vector<void *> stack;
+    auto escape = [&](void *ptr) {
+        auto it = region->objects.find(ptr);
+        if (it != region->objects.end() && escaped.insert(*it).second) {
+            stack.push_back(ptr);
         }
-        for (const auto &[ptr, obj]: young_roots_) {
-            Mark(obj);
+    };
+    for (const auto &[ptr, obj]: region->objects) {
+        if (obj->is_root || (obj->parent && !region->objects.contains(obj->parent) && FindAnyObject(obj->parent))) {
+            escape(ptr);
         }
+    }
+    bool escaped_more = true;
+    while (escaped_more) {
+        while (!stack.empty()) {
+            void *ptr = stack.back();
+            stack.pop_back();
+            for (ObjectRef next: region->objects[ptr]->edges) {
+                escape(FromRef(next)->memory.get());
+            }
+        }
+        for (const auto &[map, key]: region->weak_entries) {
+            auto it = map->entries.find(key);
+            if (it != map->entries.end() && (!region->objects.contains(key) || escaped.contains(key))) {
+                escape(it->second);
+            }
+        }
+        escaped_more = !stack.empty();
+    }
 
-        Sweep(old_gen_);
-        Sweep(young_gen_);
-
+    for (const auto &[ptr, obj]: escaped) {
+        region->objects.erase(ptr);
+    }
+    Region *outer = CurrentRegion();
+    for (WeakRef *ref: region->weak_refs) {
+        if (region->objects.contains(ref->target)) {
+            ref->target = nullptr;
+        } else if (outer) {
+            outer->weak_refs.insert(ref);
+        }
+    }
+    std::vector<WeakEntry> kept_entries;
+    for (const auto &[map, key]: region->weak_entries) {
+        auto it = map->entries.find(key);
+        if (it == map->entries.end()) {
+            continue;
+        }
+        if (region->objects.contains(key)) {
+            map->entries.erase(it);
+        } else if (outer) {
+            kept_entries.emplace_back(map, key);
+        }
+    }
+    region->objects.clear();
 
-        for (const auto &[ptr, obj]: young_gen_) {
-            old_gen_.insert({ptr, obj});
-            if (obj->is_root) {
-                old_roots_.insert({ptr, obj});
-            }
+    for (const auto &[ptr, obj]: escaped) {
+        if (outer) {
+            outer->objects.insert({ptr, obj});
+            continue;
+        }
+        obj->in_region = false;
+        young_gen_.insert({ptr, obj});
+        young_gen_size_ += obj->size;
+        if (obj->is_root) {
+            young_roots_.insert({ptr, obj});
         }
+        RememberOldParent(obj);
+    }
+    for (const auto &[ptr, obj]: escaped) {
+        RememberRegionParent(ptr, obj);
+    }
+    for (const auto &[map, key]: kept_entries) {
+        RememberRegionWeakEntry(map, key);
+    }
+    for (const auto &[ptr, obj]: region->outside_children) {
+        if (!FindAnyObject(obj->parent)) {
+            obj->parent = nullptr;
+        }
+        RememberRegionParent(ptr, obj);
+    }
+}
+
+template<typename Policy>
+size_t GenerationalGC<Policy>::GetCollectionsCount() {
+    return collections_count_.load();
+}
 
-        young_gen_.clear();
-        young_from_old_.clear();
+template<typename Policy>
+size_t GenerationalGC<Policy>::GetSnapshotSize() {
+    return snapshot_size_.load();
+}
 
-        young_gen_size_ = 0;
-        old_gen_size_ = 0;
+template<typename Policy>
+size_t GenerationalGC<Policy>::GetYoungGenSize() {
+    return young_gen_size_.load();
+}
 
-        for (const auto &[ptr, obj]: old_gen_) {
-            old_gen_size_ += obj->size;
+template<typename Policy>
+size_t GenerationalGC<Policy>::GetOldGenSize() {
+    return old_gen_size_.load();
+}
+
+template<typename Policy>
+void GenerationalGC<Policy>::MinorCollect() {
+    Collect(false);
+}
+
+template<typename Policy>
+void GenerationalGC<Policy>::MajorCollect() {
+    Collect(true);
+}
+
+template<typename Policy>
+void GenerationalGC<Policy>::CollectYoung() {
+    std::lock_guard<Mutex> lock(gc_mutex_);
+    std::chrono::steady_clock::time_point start;
+    size_t size_before = young_gen_size_.load();
+    if constexpr (Policy::kStatistics) {
+        start = std::chrono::steady_clock::now();
+    }
+
+    for (const auto &[ptr, obj]: young_roots_) {
+        Mark(obj.get());
+    }
+    for (ObjectRef ref: young_from_old_) {
+        Mark(FromRef(ref));
+    }
+    for (ObjectRef ref: snapshot_children_) {
+        Mark(FromRef(ref));
+    }
+    MarkRegionChildren();
+    ProcessMarkQueue(false);
+    MarkEphemerons(false);
+    ReleaseMarkQueue();
+    if constexpr (Policy::kStatistics) {
+        last_mark_ms_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    ClearWeakReferences(false);
+
+    Sweep(young_gen_);
+    young_gen_size_ = 0;
+    for (const auto &[ptr, obj]: young_gen_) {
+        young_gen_size_ += obj->size;
+    }
+
+    if constexpr (Policy::kStatistics) {
+        auto end = std::chrono::steady_clock::now();
+        double pause_ms = std::chrono::duration<double, std::milli>(end - start).count();
+        double interval_ms = std::chrono::duration<double, std::milli>(start - last_cycle_end_).count();
+        AdaptYoungGen(size_before, young_gen_size_.load(), pause_ms, interval_ms);
+        last_cycle_end_ = end;
+    }
+    young_gen_size_after_cycle_ = young_gen_size_.load();
+}
+
+template<typename Policy>
+void GenerationalGC<Policy>::CollectFull() {
+    std::lock_guard<Mutex> lock(gc_mutex_);
+    std::chrono::steady_clock::time_point start;
+    if constexpr (Policy::kStatistics) {
+        start = std::chrono::steady_clock::now();
+    }
+    for (const auto &[ptr, obj]: old_roots_) {
+        Mark(obj.get());
+    }
+    for (const auto &[ptr, obj]: young_roots_) {
+        Mark(obj.get());
+    }
+    for (ObjectRef ref: snapshot_children_) {
+        Mark(FromRef(ref));
+    }
+    MarkRegionChildren();
+    ProcessMarkQueue(true);
+    MarkEphemerons(true);
+    ReleaseMarkQueue();
+    if constexpr (Policy::kStatistics) {
+        last_mark_ms_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    ClearWeakReferences(true);
+
+    Sweep(old_gen_);
+    Sweep(young_gen_);
+
+    for (const auto &[ptr, obj]: young_gen_) {
+        obj->old = true;
+        old_gen_.insert({ptr, obj});
+        if (obj->is_root) {
+            old_roots_.insert({ptr, obj});
         }
     }
 
-    IncCollectionsCount();
-    gc_in_progress_.store(false);
+    young_gen_.clear();
+    young_from_old_.clear();
+    PruneYoungWeakReferences();
+
+    young_gen_size_ = 0;
+    old_gen_size_ = 0;
+
+    for (const auto &[ptr, obj]: old_gen_) {
+        old_gen_size_ += obj->size;
+    }
+
+    if constexpr (Policy::kStatistics) {
+        last_cycle_end_ = std::chrono::steady_clock::now();
+    }
+    young_gen_size_after_cycle_ = 0;
 }
 
 
-void GenerationalGC::ConfigureThresholds(size_t young_threshold, size_t old_threshold,
+template<typename Policy>
+void GenerationalGC<Policy>::ConfigureThresholds(size_t young_threshold, size_t old_threshold,
                                          double young_ratio, double old_ratio) {
     young_gen_threshold_ = young_threshold;
     old_gen_threshold_ = old_threshold;
@@ -224,31 +696,227 @@ void GenerationalGC::ConfigureThresholds(size_t young_threshold, size_t old_thre
     old_gen_ratio_ = old_ratio;
 }
 
-void GenerationalGC::IncCollectionsCount() {
+template<typename Policy>
+void GenerationalGC<Policy>::ConfigureAdaptiveYoungGen(bool enabled, size_t min_threshold, size_t max_threshold,
+                                               double target_pause_ms, double target_gc_cpu_fraction) {
+    if (min_threshold > max_threshold) {
+        throw std::invalid_argument("min_threshold must not exceed max_threshold");
+    }
+    young_gen_min_threshold_ = min_threshold;
+    young_gen_max_threshold_ = max_threshold;
+    target_minor_pause_ms_ = target_pause_ms;
+    target_gc_cpu_fraction_ = target_gc_cpu_fraction;
+    adaptive_young_gen_ = enabled;
+}
+
+template<typename Policy>
+void GenerationalGC<Policy>::ConfigureMemoryPressure(const char *cgroup_dir, size_t min_headroom, double max_pressure) {
+    std::lock_guard<Mutex> lock(pressure_mutex_);
+    pressure_monitor_ = cgroup_dir ? std::make_unique<MemoryPressureMonitor>(cgroup_dir) : nullptr;
+    min_memory_headroom_ = min_headroom;
+    max_memory_pressure_ = max_pressure;
+    pressure_collected_ = false;
+    last_pressure_collection_ = {};
+    pressure_scale_ = 1.0;
+    memory_headroom_ = SIZE_MAX;
+}
+
+template<typename Policy>
+size_t GenerationalGC<Policy>::GetMemoryHeadroom() {
+    return memory_headroom_.load();
+}
+
+template<typename Policy>
+size_t GenerationalGC<Policy>::GetMemoryPressureCollections() {
+    return pressure_collections_.load();
+}
+
+// Polled from the GC thread. When the cgroup has less than min_memory_headroom_ left before its
+// limit, or PSI reports stalls above max_memory_pressure_, the thresholds are tightened in
+// proportion to the remaining headroom, a major collection runs and the freed memory is handed
+// back to the system. Collecting again only helps once the heap has grown or the cgroup has lost
+// more headroom, so until then the collection is skipped, and it never runs more than once per
+// PRESSURE_COLLECTION_INTERVAL. Returns whether it collected.
+template<typename Policy>
+bool GenerationalGC<Policy>::CheckMemoryPressure() {
+    MemoryPressure pressure;
+    size_t min_headroom;
+    double max_pressure;
+    {
+        std::lock_guard<Mutex> lock(pressure_mutex_);
+        if (!pressure_monitor_ || !pressure_monitor_->Sample(pressure)) {
+            pressure_scale_ = 1.0;
+            memory_headroom_ = SIZE_MAX;
+            return false;
+        }
+        min_headroom = min_memory_headroom_;
+        max_pressure = max_memory_pressure_;
+    }
+
+    size_t headroom = SIZE_MAX;
+    if (pressure.limit) {
+        headroom = pressure.limit > pressure.usage ? pressure.limit - pressure.usage : 0;
+    }
+    memory_headroom_ = headroom;
+
+    bool low_headroom = pressure.limit && headroom < min_headroom;
+    bool stalling = max_pressure > 0 && pressure.some_avg10 > max_pressure;
+    // Once the pressure is gone the thresholds are relaxed step by step, so that the next burst
+    // of allocations still meets the tightened ones.
+    if (!low_headroom && !stalling) {
+        pressure_scale_ = std::min(pressure_scale_.load() * 2, 1.0);
+        std::lock_guard<Mutex> lock(pressure_mutex_);
+        pressure_collected_ = false;
+        return false;
+    }
+
+    double scale = 0.5;
+    if (low_headroom) {
+        scale = std::min(scale, static_cast<double>(headroom) / static_cast<double>(min_headroom));
+    }
+    pressure_scale_ = std::max(scale, 0.1);
+
+    auto now = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<Mutex> lock(pressure_mutex_);
+        bool changed = !pressure_collected_ || headroom < pressure_headroom_ ||
+                       young_gen_size_.load() + old_gen_size_.load() > pressure_heap_size_;
+        if (!changed || now - last_pressure_collection_ < std::chrono::milliseconds(PRESSURE_COLLECTION_INTERVAL)) {
+            return false;
+        }
+        last_pressure_collection_ = now;
+        pressure_collected_ = true;
+        pressure_headroom_ = headroom;
+    }
+
+    MajorCollect();
+    ReleaseFreeMemory();
+    pressure_collections_.fetch_add(1);
+    std::lock_guard<Mutex> lock(pressure_mutex_);
+    pressure_heap_size_ = young_gen_size_.load() + old_gen_size_.load();
+    return true;
+}
+
+template<typename Policy>
+void GenerationalGC<Policy>::ReleaseFreeMemory() {
+#ifdef GC_COMPRESSED_REFS
+    CompressedHeap::Instance().Trim();
+#endif
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+}
+
+template<typename Policy>
+size_t GenerationalGC<Policy>::GetYoungGenThreshold() {
+    return static_cast<size_t>(static_cast<double>(young_gen_threshold_.load()) * pressure_scale_.load());
+}
+
+template<typename Policy>
+double GenerationalGC<Policy>::GetYoungGenSurvivalRate() {
+    return young_gen_survival_rate_.load();
+}
+
+template<typename Policy>
+double GenerationalGC<Policy>::GetLastMinorPauseMs() {
+    return last_minor_pause_ms_.load();
+}
+
+template<typename Policy>
+double GenerationalGC<Policy>::GetLastMarkMs() {
+    return last_mark_ms_.load();
+}
+
+template<typename Policy>
+double GenerationalGC<Policy>::GetAllocationRate() {
+    return allocation_rate_.load();
+}
+
+// Resizes the young generation after a minor cycle. An over-budget pause shrinks the nursery
+// proportionally; spending too much of the wall time in GC grows it, as long as the pause
+// predicted for the larger nursery still fits the budget. When both targets are met with
+// plenty of room, the nursery slowly shrinks back to keep the footprint small.
+template<typename Policy>
+void GenerationalGC<Policy>::AdaptYoungGen(size_t size_before, size_t size_after, double pause_ms, double interval_ms) {
+    double survival_rate = size_before ? static_cast<double>(size_after) / static_cast<double>(size_before) : 0.0;
+    size_t allocated = size_before > young_gen_size_after_cycle_ ? size_before - young_gen_size_after_cycle_ : 0;
+
+    young_gen_survival_rate_ = survival_rate;
+    last_minor_pause_ms_ = pause_ms;
+    if (interval_ms > 0) {
+        allocation_rate_ = static_cast<double>(allocated) * 1000.0 / interval_ms;
+    }
+
+    if (!adaptive_young_gen_.load()) {
+        return;
+    }
+
+    double target_pause = target_minor_pause_ms_.load();
+    double target_fraction = target_gc_cpu_fraction_.load();
+    double gc_fraction = pause_ms + interval_ms > 0 ? pause_ms / (pause_ms + interval_ms) : 0.0;
+
+    double scale = 1.0;
+    if (pause_ms > target_pause) {
+        scale = std::max(0.5, pause_ms > 0 ? target_pause / pause_ms : 0.5);
+    } else if (gc_fraction > target_fraction) {
+        scale = target_fraction > 0 ? std::min(2.0, gc_fraction / target_fraction) : 2.0;
+        if (pause_ms > 0) {
+            scale = std::max(1.0, std::min(scale, target_pause / pause_ms));
+        }
+    } else if (pause_ms < target_pause / 2 && gc_fraction < target_fraction / 2) {
+        scale = 0.9;
+    }
+
+    auto threshold = static_cast<size_t>(static_cast<double>(young_gen_threshold_.load()) * scale);
+    young_gen_threshold_ = std::clamp(threshold, young_gen_min_threshold_.load(), young_gen_max_threshold_.load());
+}
+
+template<typename Policy>
+void GenerationalGC<Policy>::IncCollectionsCount() {
     collections_count_.fetch_add(1);
 }
 
-void GenerationalGC::Mark(std::shared_ptr<GCObject> root) {
-    std::vector<std::shared_ptr<GCObject> > stack;
-    stack.push_back(root);
-
-    while (!stack.empty()) {
-        auto current = stack.back();
-        stack.pop_back();
-        if (!current->mark) {
-            current->mark = true;
-            std::lock_guard<std::mutex> edge_lock(current->edges_mutex);
-            for (const auto &next: current->edges) {
-                auto obj = FindObject(next);
-                if (!obj->mark) {
-                    stack.push_back(obj);
-                }
-            }
+template<typename Policy>
+void GenerationalGC<Policy>::Mark(GCObject *obj) {
+    mark_queue_.push_back(ToRef(obj));
+}
+
+// Drains the mark queue in FIFO order. Children are queued without being touched, and each
+// entry is prefetched a few slots before it is dequeued, so its mark bit is usually in cache
+// by the time it is checked. A minor collection stops at old objects: young objects reachable
+// through them are already in young_from_old_. The dequeued prefix is dropped once it makes up
+// half the queue, so the queue stays near the size of the marking frontier rather than growing
+// to one entry per edge traced.
+template<typename Policy>
+void GenerationalGC<Policy>::ProcessMarkQueue(bool major) {
+    for (size_t head = 0; head < mark_queue_.size(); ++head) {
+        if (head >= MARK_QUEUE_COMPACT_MIN && head * 2 >= mark_queue_.size()) {
+            mark_queue_.erase(mark_queue_.begin(), mark_queue_.begin() + static_cast<std::ptrdiff_t>(head));
+            head = 0;
+        }
+        if (head + MARK_PREFETCH_DISTANCE < mark_queue_.size()) {
+            __builtin_prefetch(FromRef(mark_queue_[head + MARK_PREFETCH_DISTANCE]));
         }
+        GCObject *current = FromRef(mark_queue_[head]);
+        if (current->mark || current->in_region || current->permanent || (!major && current->old)) {
+            continue;
+        }
+        current->mark = true;
+        mark_queue_.insert(mark_queue_.end(), current->edges.begin(), current->edges.end());
+    }
+    mark_queue_.clear();
+}
+
+// A large graph leaves a large queue behind; only a modest one is worth keeping for the next cycle.
+template<typename Policy>
+void GenerationalGC<Policy>::ReleaseMarkQueue() {
+    if (mark_queue_.capacity() > MARK_QUEUE_RETAINED_CAPACITY) {
+        std::vector<ObjectRef>().swap(mark_queue_);
     }
 }
 
-void GenerationalGC::Sweep(std::unordered_map<void *, std::shared_ptr<GCObject> > &generation) {
+template<typename Policy>
+void GenerationalGC<Policy>::Sweep(std::unordered_map<void *, std::shared_ptr<GCObject> > &generation) {
     auto it = generation.begin();
     while (it != generation.end()) {
         if (!(it->second)->mark) {
@@ -260,17 +928,229 @@ void GenerationalGC::Sweep(std::unordered_map<void *, std::shared_ptr<GCObject>
     }
 }
 
-std::shared_ptr<GCObject> GenerationalGC::FindObject(void *ptr) {
+// A minor collection does not trace the old generation, so old objects count as live there.
+template<typename Policy>
+bool GenerationalGC<Policy>::IsLive(void *ptr, bool major) {
+    auto obj = FindAnyObject(ptr);
+    if (!obj) {
+        return false;
+    }
+    return obj->mark || obj->in_region || obj->permanent || (!major && obj->old);
+}
+
+template<typename Policy>
+bool GenerationalGC<Policy>::IsYoung(void *ptr) {
+    auto obj = FindAnyObject(ptr);
+    return obj && !obj->old && !obj->permanent;
+}
+
+template<typename Policy>
+bool GenerationalGC<Policy>::MarkEphemeron(void *key, void *value, bool major) {
+    if (!IsLive(key, major) || IsLive(value, major)) {
+        return false;
+    }
+    auto value_obj = FindObject(value);
+    if (!value_obj) {
+        return false;
+    }
+    Mark(value_obj.get());
+    ProcessMarkQueue(major);
+    return true;
+}
+
+// Marks weak map values whose keys were reached. Marking a value may reach further keys,
+// so the tables are rescanned until nothing new is marked. A minor collection only has to
+// consider entries with a young value: every other value is already live.
+template<typename Policy>
+void GenerationalGC<Policy>::MarkEphemerons(bool major) {
+    bool marked = true;
+    while (marked) {
+        marked = false;
+        if (!major) {
+            for (const auto &[map, key]: young_weak_entries_) {
+                auto it = map->entries.find(key);
+                if (it != map->entries.end() && MarkEphemeron(key, it->second, false)) {
+                    marked = true;
+                }
+            }
+            continue;
+        }
+        for (const auto &[handle, map]: weak_maps_) {
+            for (const auto &[key, value]: map->entries) {
+                if (MarkEphemeron(key, value, true)) {
+                    marked = true;
+                }
+            }
+        }
+    }
+}
+
+template<typename Policy>
+void GenerationalGC<Policy>::ClearWeakReferences(bool major) {
+    if (!major) {
+        std::erase_if(young_weak_refs_, [this](WeakRef *ref) {
+            if (ref->target && !IsLive(ref->target, false)) {
+                ref->target = nullptr;
+            }
+            return !ref->target;
+        });
+        std::erase_if(young_weak_entries_, [this](const WeakEntry &entry) {
+            auto &[map, key] = entry;
+            auto it = map->entries.find(key);
+            if (it == map->entries.end()) {
+                return true;
+            }
+            if (!IsLive(key, false)) {
+                map->entries.erase(it);
+                return true;
+            }
+            return false;
+        });
+        return;
+    }
+    for (const auto &[handle, ref]: weak_refs_) {
+        if (ref->target && !IsLive(ref->target, true)) {
+            ref->target = nullptr;
+        }
+    }
+    for (const auto &[handle, map]: weak_maps_) {
+        std::erase_if(map->entries, [this](const auto &entry) {
+            return !IsLive(entry.first, true);
+        });
+    }
+}
+
+// Called once a major collection has promoted the young generation: only references into
+// regions remain young.
+template<typename Policy>
+void GenerationalGC<Policy>::PruneYoungWeakReferences() {
+    std::erase_if(young_weak_refs_, [this](WeakRef *ref) {
+        return !ref->target || !IsYoung(ref->target);
+    });
+    std::erase_if(young_weak_entries_, [this](const WeakEntry &entry) {
+        auto &[map, key] = entry;
+        auto it = map->entries.find(key);
+        return it == map->entries.end() || (!IsYoung(key) && !IsYoung(it->second));
+    });
+}
+
+template<typename Policy>
+std::shared_ptr<GCObject> GenerationalGC<Policy>::FindObject(void *ptr) {
     if (young_gen_.contains(ptr)) {
         return young_gen_[ptr];
     } else if (old_gen_.contains(ptr)) {
         return old_gen_[ptr];
+    } else if (snapshot_gen_.contains(ptr)) {
+        return snapshot_gen_[ptr];
     } else {
         return nullptr;
     }
 }
 
-GenerationalGC &GenerationalGC::GetInstance() {
+template<typename Policy>
+std::shared_ptr<GCObject> GenerationalGC<Policy>::FindAnyObject(void *ptr) {
+    if (auto obj = FindObject(ptr)) {
+        return obj;
+    }
+    if (Region *region = FindRegion(ptr)) {
+        return region->objects[ptr];
+    }
+    return nullptr;
+}
+
+template<typename Policy>
+Region *GenerationalGC<Policy>::FindRegion(void *ptr) {
+    if (regions_open_.load() == 0) {
+        return nullptr;
+    }
+    for (const auto &[thread_id, stack]: regions_) {
+        for (const auto &region: stack) {
+            if (region->objects.contains(ptr)) {
+                return region.get();
+            }
+        }
+    }
+    return nullptr;
+}
+
+template<typename Policy>
+Region *GenerationalGC<Policy>::CurrentRegion() {
+    auto it = regions_.find(std::this_thread::get_id());
+    if (it == regions_.end()) {
+        return nullptr;
+    }
+    return it->second.back().get();
+}
+
+// Roots and objects linked from outside the region are known to escape it, so they get their own
+// payload rather than a slice of the chunk, which they would otherwise keep alive once it ends.
+template<typename Policy>
+void *GenerationalGC<Policy>::RegionMalloc(Region *region, size_t size, bool is_root, void *parent) {
+    std::shared_ptr<GCObject> parent_obj = parent ? FindAnyObject(parent) : nullptr;
+    bool escapes = is_root || (parent_obj && !region->objects.contains(parent));
+    auto obj = escapes ? MakeObject(is_root, size) : MakeObject(is_root, region->Allocate(size));
+    void *ptr = obj->memory.get();
+    obj->size = size;
+    obj->in_region = true;
+    if (parent_obj) {
+        parent_obj->AddEdge(obj);
+        obj->parent = parent;
+    }
+    region->objects.insert({ptr, obj});
+    return ptr;
+}
+
+template<typename Policy>
+void GenerationalGC<Policy>::RememberOldParent(const std::shared_ptr<GCObject> &obj) {
+    if (!obj->permanent && snapshot_gen_.contains(obj->parent)) {
+        snapshot_children_.insert(ToRef(obj.get()));
+    } else if (!obj->old && !obj->in_region && old_gen_.contains(obj->parent)) {
+        young_from_old_.insert(ToRef(obj.get()));
+    }
+}
+
+// Records a weak map entry with the regions its key and value live in, so RegionEnd finds it
+// without scanning every map.
+template<typename Policy>
+void GenerationalGC<Policy>::RememberRegionWeakEntry(WeakMap *map, void *key) {
+    if (regions_open_.load() == 0) {
+        return;
+    }
+    auto it = map->entries.find(key);
+    for (void *ptr: {key, it->second}) {
+        if (Region *region = FindRegion(ptr)) {
+            region->weak_entries.insert({map, key});
+        }
+    }
+}
+
+// Records obj in the remembered set of the region its parent lives in, unless both share a region.
+template<typename Policy>
+void GenerationalGC<Policy>::RememberRegionParent(void *ptr, const std::shared_ptr<GCObject> &obj) {
+    Region *parent_region = FindRegion(obj->parent);
+    if (parent_region && !parent_region->objects.contains(ptr)) {
+        parent_region->outside_children.insert({ptr, obj});
+    }
+}
+
+template<typename Policy>
+void GenerationalGC<Policy>::MarkRegionChildren() {
+    for (const auto &[thread_id, stack]: regions_) {
+        for (const auto &region: stack) {
+            for (const auto &[ptr, obj]: region->outside_children) {
+                Mark(obj.get());
+            }
+        }
+    }
+}
+
+template<typename Policy>
+GenerationalGC<Policy> &GenerationalGC<Policy>::GetInstance() {
     static GenerationalGC instance;
     return instance;
 }
+
+template class GenerationalGC<ConcurrentPolicy>;
+template class GenerationalGC<LockedPolicy>;
+template class GenerationalGC<SingleThreadedPolicy>;
+template class GenerationalGC<MinimalPolicy>;
@@ -3,30 +3,121 @@
 #include <unordered_map>
 #include <memory>
 #include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 #include <atomic>
 #include <thread>
 #include <condition_variable>
-
+#include <chrono>
+#include "compressed_heap.h"
+#include "gc_policy.h"
+#include "memory_pressure.h"
+
+struct GCObject;
+
+// Reference to an object from collector metadata: edges, the mark queue and the remembered sets.
+// With GC_COMPRESSED_REFS objects live in the CompressedHeap range and a reference is a 32-bit
+// offset into it; otherwise it is a plain pointer.
+#ifdef GC_COMPRESSED_REFS
+using ObjectRef = uint32_t;
+#else
+using ObjectRef = GCObject *;
+#endif
+
+// Edges are only mutated under the collector's gc_mutex_, so marking reads them without locking.
+// An object has at most one parent, so it sits in at most one edge list; edge_index is its slot
+// there, which lets RemEdge unlink it without searching.
 struct GCObject {
     bool mark = false;
     bool is_root = false;
-    std::mutex edges_mutex;
-    std::unordered_set<void *> edges;
-    void *parent;
-    std::unique_ptr<uint64_t[]> memory = nullptr;
+    bool in_region = false;
+    bool old = false;
+    bool permanent = false;
+    std::vector<ObjectRef> edges;
+    void *parent = nullptr;
+    std::shared_ptr<uint64_t[]> memory = nullptr;
     int size = 0;
+    uint32_t edge_index = 0;
 
     GCObject(bool is_root_value, size_t size);
 
+    GCObject(bool is_root_value, std::shared_ptr<uint64_t[]> memory_value);
+
     void AddEdge(const std::shared_ptr<GCObject> &obj);
 
     void RemEdge(const std::shared_ptr<GCObject> &obj);
 };
 
+inline ObjectRef ToRef(GCObject *obj) {
+#ifdef GC_COMPRESSED_REFS
+    return CompressedHeap::Compress(obj);
+#else
+    return obj;
+#endif
+}
+
+inline GCObject *FromRef(ObjectRef ref) {
+#ifdef GC_COMPRESSED_REFS
+    return static_cast<GCObject *>(CompressedHeap::Decompress(ref));
+#else
+    return ref;
+#endif
+}
+
+std::shared_ptr<GCObject> MakeObject(bool is_root, size_t size);
+
+std::shared_ptr<GCObject> MakeObject(bool is_root, std::shared_ptr<uint64_t[]> memory);
+
+std::shared_ptr<uint64_t[]> AllocatePayload(size_t words);
+
+struct WeakRef {
+    void *target = nullptr;
+};
+
+// Ephemeron table: a value is kept alive by the map only while its key is reachable from elsewhere.
+struct WeakMap {
+    std::unordered_map<void *, void *> entries;
+};
+
+// A weak map entry, named by its table and key.
+using WeakEntry = std::pair<WeakMap *, void *>;
+
+struct WeakEntryHash {
+    size_t operator()(const WeakEntry &entry) const {
+        return std::hash<WeakMap *>()(entry.first) * 31 + std::hash<void *>()(entry.second);
+    }
+};
+
+// Bump-allocated arena for request-scoped objects. Its objects are neither traced nor swept:
+// they are dropped together when the region ends, except for the ones that escaped it.
+struct Region {
+    std::unordered_map<void *, std::shared_ptr<GCObject>> objects;
+    // Objects outside the region whose parent lives in it; collections treat them as roots.
+    std::unordered_map<void *, std::shared_ptr<GCObject>> outside_children;
+    // Weak references whose target, and weak map entries whose key or value, lives in the region.
+    std::unordered_set<WeakRef *> weak_refs;
+    std::unordered_set<WeakEntry, WeakEntryHash> weak_entries;
+    std::shared_ptr<uint64_t[]> chunk = nullptr;
+    size_t chunk_offset = 0;
+
+    std::shared_ptr<uint64_t[]> Allocate(size_t size);
+};
+
+// Policy is a GCPolicy instantiation; it picks the lock and atomic types, whether collections are
+// triggered inline by Malloc or by a background thread, and whether statistics are gathered.
+template<typename Policy = ConcurrentPolicy>
 class GenerationalGC {
 public:
+    using Mutex = typename Policy::Mutex;
+
+    using ConditionVariable = typename Policy::ConditionVariable;
+
+    template<typename T>
+    using Atomic = typename Policy::template Atomic<T>;
+
     GenerationalGC();
 
     GenerationalGC(const GenerationalGC &) = delete;
@@ -39,6 +130,10 @@ public:
 
     void Free(void *ptr);
 
+    void RegionBegin();
+
+    void RegionEnd();
+
     void MinorCollect();
 
     void MajorCollect();
@@ -47,15 +142,66 @@ public:
 
     void ForceGarbageCollection(bool major);
 
+    size_t RequestCollection(bool major);
+
+    void WaitForCollection(size_t ticket);
+
+    bool IsCollectionDone(size_t ticket);
+
     void ConfigureThresholds(size_t young_threshold, size_t old_threshold,
                              double young_ratio, double old_ratio);
 
+    WeakRef *CreateWeakRef(void *ptr);
+
+    void *GetWeakRef(WeakRef *ref);
+
+    void FreeWeakRef(WeakRef *ref);
+
+    WeakMap *CreateWeakMap();
+
+    void WeakMapSet(WeakMap *map, void *key, void *value);
+
+    void *WeakMapGet(WeakMap *map, void *key);
+
+    void WeakMapRemove(WeakMap *map, void *key);
+
+    size_t WeakMapSize(WeakMap *map);
+
+    void FreeWeakMap(WeakMap *map);
+
+    bool SaveSnapshot(const char *path);
+
+    bool LoadSnapshot(const char *path);
+
+    size_t GetSnapshotRoots(void **roots, size_t max_roots);
+
+    size_t GetSnapshotSize();
+
     size_t GetCollectionsCount();
 
     size_t GetYoungGenSize();
 
     size_t GetOldGenSize();
 
+    void ConfigureAdaptiveYoungGen(bool enabled, size_t min_threshold, size_t max_threshold,
+                                   double target_pause_ms, double target_gc_cpu_fraction);
+
+    void ConfigureMemoryPressure(const char *cgroup_dir, size_t min_headroom, double max_pressure);
+
+    size_t GetMemoryHeadroom();
+
+    size_t GetMemoryPressureCollections();
+
+    size_t GetYoungGenThreshold();
+
+    double GetYoungGenSurvivalRate();
+
+    double GetLastMinorPauseMs();
+
+    double GetLastMarkMs();
+
+    double GetAllocationRate();
+
     void StartGCThread();
 
     void StopGCThread();
@@ -68,33 +214,140 @@ private:
     std::unordered_map<void *, std::shared_ptr<GCObject>> old_gen_;
     std::unordered_map<void *, std::shared_ptr<GCObject>> old_roots_;
     std::unordered_map<void *, std::shared_ptr<GCObject>> young_roots_;
-    std::unordered_map<void *, std::shared_ptr<GCObject>> young_from_old_;
-
-    std::mutex gc_mutex_;
-    std::mutex background_mutex_;
-
-    std::atomic<size_t> young_gen_size_{0};
-    std::atomic<size_t> old_gen_size_{0};
-    std::atomic<bool> gc_in_progress_{false};
-    std::atomic<size_t> collections_count_{0};
+    // Young objects with an old parent. The generation maps own them, and a minor collection marks
+    // them all, so they cannot be swept before a major collection clears the set.
+    std::unordered_set<ObjectRef> young_from_old_;
+
+    // Objects mapped in by LoadSnapshot. They are never traced or swept; objects parented to them
+    // are kept in snapshot_children_ and marked as roots instead.
+    std::unordered_map<void *, std::shared_ptr<GCObject>> snapshot_gen_;
+    std::unordered_set<ObjectRef> snapshot_children_;
+    std::vector<void *> snapshot_roots_;
+    Atomic<size_t> snapshot_size_{0};
+
+    std::unordered_map<std::thread::id, std::vector<std::unique_ptr<Region>>> regions_;
+    Atomic<size_t> regions_open_{0};
+
+    std::unordered_map<WeakRef *, std::unique_ptr<WeakRef>> weak_refs_;
+    std::unordered_map<WeakMap *, std::unique_ptr<WeakMap>> weak_maps_;
+    // Weak references and weak map entries whose target, key or value is neither old nor permanent.
+    // Everything else only points at objects a minor collection keeps, so minor collections look
+    // at these alone.
+    std::unordered_set<WeakRef *> young_weak_refs_;
+    std::unordered_set<WeakEntry, WeakEntryHash> young_weak_entries_;
+
+    Mutex gc_mutex_;
+    Mutex background_mutex_;
+    Mutex cycle_mutex_;
+    ConditionVariable cycle_done_cv_;
+    // Guarded by background_mutex_. A ticket is the number of the cycle that will serve it.
+    bool collection_requested_ = false;
+    bool major_requested_ = false;
+    size_t cycles_started_ = 0;
+    size_t cycles_completed_ = 0;
+
+    Atomic<size_t> young_gen_size_{0};
+    Atomic<size_t> old_gen_size_{0};
+    Atomic<bool> gc_in_progress_{false};
+    Atomic<size_t> collections_count_{0};
 
     std::thread gc_thread_;
-    std::atomic<bool> should_stop_{false};
-    std::condition_variable gc_cv_;
-
-    std::atomic<size_t> young_gen_threshold_ = 4 * 1024 * 1024;
-    std::atomic<size_t> old_gen_threshold_ = 16 * 1024 * 1024;
-    std::atomic<double> young_gen_ratio_ = 0.6;
-    std::atomic<double> old_gen_ratio_ = 0.80;
+    Atomic<bool> should_stop_{false};
+    ConditionVariable gc_cv_;
+
+    Atomic<size_t> young_gen_threshold_ = 4 * 1024 * 1024;
+    Atomic<size_t> old_gen_threshold_ = 16 * 1024 * 1024;
+    Atomic<double> young_gen_ratio_ = 0.6;
+    Atomic<double> old_gen_ratio_ = 0.80;
+
+    Atomic<bool> adaptive_young_gen_{false};
+    Atomic<size_t> young_gen_min_threshold_ = 256 * 1024;
+    Atomic<size_t> young_gen_max_threshold_ = 64 * 1024 * 1024;
+    Atomic<double> target_minor_pause_ms_ = 5.0;
+    Atomic<double> target_gc_cpu_fraction_ = 0.05;
+
+    Mutex pressure_mutex_;
+    std::unique_ptr<MemoryPressureMonitor> pressure_monitor_;
+    size_t min_memory_headroom_ = 0;
+    double max_memory_pressure_ = 0.0;
+    // Whether the current bout of pressure has forced a collection yet, and the GC heap size after
+    // and cgroup headroom before the last one.
+    bool pressure_collected_ = false;
+    size_t pressure_heap_size_ = 0;
+    size_t pressure_headroom_ = SIZE_MAX;
+    std::chrono::steady_clock::time_point last_pressure_collection_{};
+    // Multiplier for both generation thresholds, below 1 while the cgroup is short on memory.
+    Atomic<double> pressure_scale_{1.0};
+    Atomic<size_t> memory_headroom_{SIZE_MAX};
+    Atomic<size_t> pressure_collections_{0};
+
+    Atomic<double> young_gen_survival_rate_{0.0};
+    Atomic<double> last_minor_pause_ms_{0.0};
+    Atomic<double> last_mark_ms_{0.0};
+    Atomic<double> allocation_rate_{0.0};
+    std::chrono::steady_clock::time_point last_cycle_end_ = std::chrono::steady_clock::now();
+    Atomic<size_t> young_gen_size_after_cycle_{0};
+    Atomic<size_t> allocations_since_poll_{0};
+    std::chrono::steady_clock::time_point last_poll_ = std::chrono::steady_clock::now();
 
     void GCThreadFunction();
 
     void IncCollectionsCount();
 
-    void Mark(std::shared_ptr<GCObject> root);
+    size_t Collect(bool major);
+
+    void CollectIfNeeded(bool periodic);
+
+    void PollMemoryPressure();
+
+    void CollectYoung();
+
+    void CollectFull();
+
+    bool CheckMemoryPressure();
+
+    void ReleaseFreeMemory();
+
+    void AdaptYoungGen(size_t size_before, size_t size_after, double pause_ms, double interval_ms);
+
+    std::vector<ObjectRef> mark_queue_;
+
+    void Mark(GCObject *obj);
+
+    void ProcessMarkQueue(bool major);
+
+    void ReleaseMarkQueue();
 
     void Sweep(std::unordered_map<void *, std::shared_ptr<GCObject>> &generation);
 
+    bool IsLive(void *ptr, bool major);
+
+    bool IsYoung(void *ptr);
+
+    bool MarkEphemeron(void *key, void *value, bool major);
+
+    void MarkEphemerons(bool major);
+
+    void ClearWeakReferences(bool major);
+
+    void PruneYoungWeakReferences();
+
     std::shared_ptr<GCObject> FindObject(void *ptr);
 
+    std::shared_ptr<GCObject> FindAnyObject(void *ptr);
+
+    Region *FindRegion(void *ptr);
+
+    Region *CurrentRegion();
+
+    void *RegionMalloc(Region *region, size_t size, bool is_root, void *parent);
+
+    void RememberRegionParent(void *ptr, const std::shared_ptr<GCObject> &obj);
+
+    void RememberOldParent(const std::shared_ptr<GCObject> &obj);
+
+    void RememberRegionWeakEntry(WeakMap *map, void *key);
+
+    void MarkRegionChildren();
+
 };
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <type_traits>
+
+enum class GCThreading {
+    // One thread only: locks and atomics compile down to plain operations.
+    kNone,
+    // Many mutator threads, collections run on the thread that triggers them.
+    kLocked,
+    // Many mutator threads plus a background collector thread.
+    kConcurrent,
+};
+
+enum class GCTrigger {
+    // Allocation checks the thresholds and collects on the allocating thread.
+    kInline,
+    // A background thread checks the thresholds periodically.
+    kBackground,
+};
+
+struct NullMutex {
+    void lock() {
+    }
+
+    void unlock() {
+    }
+
+    bool try_lock() {
+        return true;
+    }
+};
+
+// Plain value with the part of the std::atomic interface the collector uses.
+template<typename T>
+class PlainAtomic {
+public:
+    PlainAtomic() = default;
+
+    PlainAtomic(T value) : value_(value) {
+    }
+
+    T load() const {
+        return value_;
+    }
+
+    void store(T value) {
+        value_ = value;
+    }
+
+    T fetch_add(T delta) {
+        T old = value_;
+        value_ += delta;
+        return old;
+    }
+
+    PlainAtomic &operator=(T value) {
+        value_ = value;
+        return *this;
+    }
+
+    T operator+=(T delta) {
+        return value_ += delta;
+    }
+
+    T operator-=(T delta) {
+        return value_ -= delta;
+    }
+
+    operator T() const {
+        return value_;
+    }
+
+private:
+    T value_{};
+};
+
+// Statistics are the pause, survival and allocation rate measurements; adaptive young
+// generation sizing depends on them and is inert when they are off.
+template<GCThreading Threading, GCTrigger Trigger, bool Statistics>
+struct GCPolicy {
+    static_assert(Trigger == GCTrigger::kInline || Threading == GCThreading::kConcurrent,
+                  "a background collector thread needs the concurrent threading model");
+
+    static constexpr GCThreading kThreading = Threading;
+    static constexpr GCTrigger kTrigger = Trigger;
+    static constexpr bool kStatistics = Statistics;
+
+    using Mutex = std::conditional_t<Threading == GCThreading::kNone, NullMutex, std::mutex>;
+
+    // std::condition_variable only waits on std::mutex; NullMutex needs the generic one.
+    using ConditionVariable = std::conditional_t<std::is_same_v<Mutex, std::mutex>,
+                                                 std::condition_variable, std::condition_variable_any>;
+
+    template<typename T>
+    using Atomic = std::conditional_t<Threading == GCThreading::kNone, PlainAtomic<T>, std::atomic<T>>;
+};
+
+using ConcurrentPolicy = GCPolicy<GCThreading::kConcurrent, GCTrigger::kBackground, true>;
+using LockedPolicy = GCPolicy<GCThreading::kLocked, GCTrigger::kInline, true>;
+using SingleThreadedPolicy = GCPolicy<GCThreading::kNone, GCTrigger::kInline, true>;
+// Single-threaded without statistics: no locks, no atomics and no clock reads around cycles.
+using MinimalPolicy = GCPolicy<GCThreading::kNone, GCTrigger::kInline, false>;
@@ -0,0 +1,242 @@
+#include "gc_impl.h"
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Snapshot file layout, all fields 8 bytes wide so that every section stays word aligned:
+//   SnapshotHeader | SnapshotObject[object_count] | edges: uint64_t[edge_count]
+//   | SnapshotRelocation[relocation_count] | payload: uint64_t[payload_words]
+// Objects refer to each other by index, which keeps the file independent of the addresses
+// it was written from. Payload words that held the address of a saved object are recorded
+// as relocations and patched with the new address on load.
+
+constexpr char SNAPSHOT_MAGIC[8] = {'G', 'C', 'S', 'N', 'A', 'P', '0', '1'};
+constexpr uint64_t NO_PARENT = UINT64_MAX;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint64_t object_count;
+    uint64_t edge_count;
+    uint64_t relocation_count;
+    uint64_t payload_words;
+};
+
+struct SnapshotObject {
+    uint64_t payload_offset;
+    uint64_t size;
+    uint64_t parent;
+    uint64_t edges_offset;
+    uint64_t edges_count;
+    uint64_t is_root;
+};
+
+struct SnapshotRelocation {
+    uint64_t word;
+    uint64_t target;
+};
+
+static size_t PayloadWords(size_t size) {
+    return size / 8 + 1;
+}
+
+// Everything is copied into buffers under gc_mutex_, and the file is written after releasing it,
+// so mutators only wait for the copy and not for the disk. The file is written next to path and
+// renamed over it once complete, so a failed save leaves any previous snapshot intact.
+template<typename Policy>
+bool GenerationalGC<Policy>::SaveSnapshot(const char *path) {
+    SnapshotHeader header{};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    std::vector<SnapshotObject> records;
+    std::vector<uint64_t> edges;
+    std::vector<SnapshotRelocation> relocations;
+    std::vector<uint64_t> payload;
+    {
+        std::lock_guard<Mutex> lock(gc_mutex_);
+
+        std::vector<std::shared_ptr<GCObject>> objects;
+        std::unordered_map<GCObject *, uint64_t> index;
+        std::unordered_map<uint64_t, uint64_t> address_index;
+        for (auto *generation: {&snapshot_gen_, &old_gen_}) {
+            for (const auto &[ptr, obj]: *generation) {
+                index[obj.get()] = objects.size();
+                address_index[reinterpret_cast<uint64_t>(ptr)] = objects.size();
+                objects.push_back(obj);
+            }
+        }
+        header.object_count = objects.size();
+
+        records.reserve(objects.size());
+        for (const auto &obj: objects) {
+            SnapshotObject record{};
+            record.payload_offset = payload.size();
+            record.size = obj->size;
+            record.is_root = obj->is_root;
+            auto parent = address_index.find(reinterpret_cast<uint64_t>(obj->parent));
+            record.parent = parent == address_index.end() ? NO_PARENT : parent->second;
+            record.edges_offset = edges.size();
+            for (ObjectRef next: obj->edges) {
+                auto it = index.find(FromRef(next));
+                if (it != index.end()) {
+                    edges.push_back(it->second);
+                }
+            }
+            record.edges_count = edges.size() - record.edges_offset;
+
+            size_t words = PayloadWords(obj->size);
+            for (size_t i = 0; i < words; ++i) {
+                auto target = address_index.find(obj->memory[i]);
+                if (target != address_index.end()) {
+                    relocations.push_back({payload.size() + i, target->second});
+                }
+            }
+            payload.insert(payload.end(), obj->memory.get(), obj->memory.get() + words);
+            records.push_back(record);
+        }
+    }
+    header.edge_count = edges.size();
+    header.relocation_count = relocations.size();
+    header.payload_words = payload.size();
+
+    std::string tmp_path = std::string(path) + ".tmp";
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(records.data()),
+              static_cast<std::streamsize>(records.size() * sizeof(SnapshotObject)));
+    out.write(reinterpret_cast<const char *>(edges.data()),
+              static_cast<std::streamsize>(edges.size() * sizeof(uint64_t)));
+    out.write(reinterpret_cast<const char *>(relocations.data()),
+              static_cast<std::streamsize>(relocations.size() * sizeof(SnapshotRelocation)));
+    out.write(reinterpret_cast<const char *>(payload.data()),
+              static_cast<std::streamsize>(payload.size() * sizeof(uint64_t)));
+    out.close();
+    if (!out || std::rename(tmp_path.c_str(), path) != 0) {
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+// The file is mapped privately, so payloads are used in place: pages are only copied once they
+// are written to, either by a relocation or by the program itself.
+template<typename Policy>
+bool GenerationalGC<Policy>::LoadSnapshot(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SnapshotHeader)) {
+        close(fd);
+        return false;
+    }
+    size_t length = st.st_size;
+    void *base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+    std::shared_ptr<uint64_t[]> mapping(static_cast<uint64_t *>(base), [length](uint64_t *ptr) {
+        munmap(ptr, length);
+    });
+
+    const auto *header = reinterpret_cast<const SnapshotHeader *>(base);
+    size_t words = length / sizeof(uint64_t);
+    size_t header_words = sizeof(SnapshotHeader) / sizeof(uint64_t);
+    if (std::memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+        header->object_count > words || header->edge_count > words || header->relocation_count > words ||
+        header->payload_words > words) {
+        return false;
+    }
+    size_t records_words = header->object_count * sizeof(SnapshotObject) / sizeof(uint64_t);
+    size_t relocations_words = header->relocation_count * sizeof(SnapshotRelocation) / sizeof(uint64_t);
+    if (header_words + records_words + header->edge_count + relocations_words + header->payload_words > words) {
+        return false;
+    }
+
+    const auto *records = reinterpret_cast<const SnapshotObject *>(mapping.get() + header_words);
+    const uint64_t *edges = mapping.get() + header_words + records_words;
+    const auto *relocations = reinterpret_cast<const SnapshotRelocation *>(edges + header->edge_count);
+    uint64_t *payload = mapping.get() + header_words + records_words + header->edge_count + relocations_words;
+
+    std::vector<std::shared_ptr<GCObject>> objects;
+    objects.reserve(header->object_count);
+    for (size_t i = 0; i < header->object_count; ++i) {
+        const SnapshotObject &record = records[i];
+        // Offsets and counts are checked one at a time, so that a corrupt file cannot wrap a sum.
+        if (record.size > INT_MAX || record.payload_offset > header->payload_words ||
+            PayloadWords(record.size) > header->payload_words - record.payload_offset ||
+            record.edges_offset > header->edge_count || record.edges_count > header->edge_count - record.edges_offset ||
+            (record.parent != NO_PARENT && record.parent >= header->object_count)) {
+            return false;
+        }
+        auto obj = MakeObject(record.is_root != 0, std::shared_ptr<uint64_t[]>(mapping, payload + record.payload_offset));
+        obj->size = static_cast<int>(record.size);
+        obj->old = true;
+        obj->permanent = true;
+        objects.push_back(std::move(obj));
+    }
+    for (size_t i = 0; i < header->relocation_count; ++i) {
+        const SnapshotRelocation &relocation = relocations[i];
+        if (relocation.word >= header->payload_words || relocation.target >= header->object_count) {
+            return false;
+        }
+        payload[relocation.word] = reinterpret_cast<uint64_t>(objects[relocation.target]->memory.get());
+    }
+    for (size_t i = 0; i < header->object_count; ++i) {
+        const SnapshotObject &record = records[i];
+        if (record.parent != NO_PARENT) {
+            objects[i]->parent = objects[record.parent]->memory.get();
+        }
+        for (size_t j = 0; j < record.edges_count; ++j) {
+            uint64_t target = edges[record.edges_offset + j];
+            if (target >= header->object_count) {
+                return false;
+            }
+            objects[i]->AddEdge(objects[target]);
+        }
+    }
+
+    std::lock_guard<Mutex> lock(gc_mutex_);
+    for (const auto &obj: objects) {
+        void *ptr = obj->memory.get();
+        snapshot_gen_.insert({ptr, obj});
+        snapshot_size_ += obj->size;
+        if (obj->is_root) {
+            snapshot_roots_.push_back(ptr);
+        }
+    }
+    return true;
+}
+
+template<typename Policy>
+size_t GenerationalGC<Policy>::GetSnapshotRoots(void **roots, size_t max_roots) {
+    std::lock_guard<Mutex> lock(gc_mutex_);
+    size_t count = std::min(max_roots, snapshot_roots_.size());
+    std::copy(snapshot_roots_.begin(), snapshot_roots_.begin() + count, roots);
+    return snapshot_roots_.size();
+}
+
+template bool GenerationalGC<ConcurrentPolicy>::SaveSnapshot(const char *path);
+template bool GenerationalGC<ConcurrentPolicy>::LoadSnapshot(const char *path);
+template size_t GenerationalGC<ConcurrentPolicy>::GetSnapshotRoots(void **roots, size_t max_roots);
+template bool GenerationalGC<LockedPolicy>::SaveSnapshot(const char *path);
+template bool GenerationalGC<LockedPolicy>::LoadSnapshot(const char *path);
+template size_t GenerationalGC<LockedPolicy>::GetSnapshotRoots(void **roots, size_t max_roots);
+template bool GenerationalGC<SingleThreadedPolicy>::SaveSnapshot(const char *path);
+template bool GenerationalGC<SingleThreadedPolicy>::LoadSnapshot(const char *path);
+template size_t GenerationalGC<SingleThreadedPolicy>::GetSnapshotRoots(void **roots, size_t max_roots);
+template bool GenerationalGC<MinimalPolicy>::SaveSnapshot(const char *path);
+template bool GenerationalGC<MinimalPolicy>::LoadSnapshot(const char *path);
+template size_t GenerationalGC<MinimalPolicy>::GetSnapshotRoots(void **roots, size_t max_roots);
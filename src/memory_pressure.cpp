@@ -0,0 +1,58 @@
+#include "memory_pressure.h"
+#include <fstream>
+#include <sstream>
+
+MemoryPressureMonitor::MemoryPressureMonitor(std::string cgroup_dir) : cgroup_dir_(std::move(cgroup_dir)) {
+}
+
+static bool ReadSize(const std::string &path, size_t &value) {
+    std::ifstream in(path);
+    std::string token;
+    if (!(in >> token)) {
+        return false;
+    }
+    try {
+        value = std::stoull(token);
+    } catch (const std::exception &) {
+        return false;
+    }
+    return true;
+}
+
+// memory.pressure looks like "some avg10=1.23 avg60=... total=...\nfull avg10=...".
+static bool ReadSomeAvg10(const std::string &path, double &value) {
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string kind;
+        std::string field;
+        fields >> kind;
+        if (kind != "some") {
+            continue;
+        }
+        while (fields >> field) {
+            if (field.rfind("avg10=", 0) == 0) {
+                try {
+                    value = std::stod(field.substr(6));
+                } catch (const std::exception &) {
+                    return false;
+                }
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool MemoryPressureMonitor::Sample(MemoryPressure &pressure) const {
+    pressure = MemoryPressure{};
+    if (!ReadSize(cgroup_dir_ + "/memory.current", pressure.usage)) {
+        return false;
+    }
+    if (!ReadSize(cgroup_dir_ + "/memory.max", pressure.limit)) {
+        pressure.limit = 0;
+    }
+    ReadSomeAvg10(cgroup_dir_ + "/memory.pressure", pressure.some_avg10);
+    return true;
+}
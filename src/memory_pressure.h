@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+struct MemoryPressure {
+    size_t limit = 0;
+    size_t usage = 0;
+    double some_avg10 = 0.0;
+};
+
+// Reads the cgroup v2 memory controller files of a single cgroup directory:
+// memory.max, memory.current and the PSI file memory.pressure.
+class MemoryPressureMonitor {
+public:
+    explicit MemoryPressureMonitor(std::string cgroup_dir);
+
+    // Returns false when memory.current cannot be read. limit is 0 when memory.max is "max"
+    // or missing, some_avg10 is 0 when PSI is not available.
+    bool Sample(MemoryPressure &pressure) const;
+
+private:
+    std::string cgroup_dir_;
+};
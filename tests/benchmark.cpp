@@ -95,6 +95,59 @@ static void CycleAllocations(benchmark::State &state) {
     }
 }
 
+static void RegionAllocations(benchmark::State &state) {
+    const int iterations = state.range(0);
+    const int temp_objects_per_iteration = state.range(1);
+    for (auto _: state) {
+        state.PauseTiming();
+        gc_collect(true);
+        state.ResumeTiming();
+
+        for (int iter = 0; iter < iterations; ++iter) {
+            GCRegionScope region;
+            void *request = gc_malloc(TEMP_OBJECT_SIZE, false, nullptr);
+            for (int j = 0; j < temp_objects_per_iteration; ++j) {
+                void *temp = gc_malloc(TEMP_OBJECT_SIZE, false, request);
+                if (j > 0 && j % 3 == 0) {
+                    gc_malloc(TEMP_OBJECT_SIZE / 2, false, temp);
+                }
+            }
+            benchmark::DoNotOptimize(request);
+        }
+
+        benchmark::ClobberMemory();
+    }
+}
+
+// Every object stays reachable, so each major collection marks the whole graph. Only the mark
+// phase is timed; sweeping and promotion are left out.
+static void MarkThroughput(benchmark::State &state) {
+    const int object_count = state.range(0);
+
+    gc_collect(true);
+    std::mt19937 gen(42);
+    std::vector<void *> objects;
+    objects.reserve(object_count);
+    objects.push_back(gc_malloc(TEMP_OBJECT_SIZE, true, nullptr));
+    for (int i = 1; i < object_count; ++i) {
+        objects.push_back(gc_malloc(TEMP_OBJECT_SIZE, false, objects[gen() % objects.size()]));
+    }
+    gc_collect(true);
+
+    double mark_seconds = 0.0;
+    for (auto _: state) {
+        gc_collect(true);
+        double seconds = get_last_mark_ms() / 1000.0;
+        state.SetIterationTime(seconds);
+        mark_seconds += seconds;
+    }
+
+    state.counters["objects/s"] = static_cast<double>(object_count) * static_cast<double>(state.iterations()) /
+                                  mark_seconds;
+    gc_free(objects.front());
+    gc_collect(true);
+}
+
 
 BENCHMARK(LargeAllocations)
         ->Args({10000, 128}) // 10000 objects 128 B each
@@ -113,4 +166,17 @@ BENCHMARK(CycleAllocations)
         ->Unit(benchmark::kMillisecond)
         ->Name("CycleAllocations")->MeasureProcessCPUTime()->Iterations(10);
 
-BENCHMARK_MAIN();
+BENCHMARK(RegionAllocations)
+        ->Args({1000, 10}) // 1000 regions, 10 temporary objects each
+        ->Args({1000, 100}) // 1000 regions, 100 temporary objects each
+        ->Args({10000, 100}) // 10000 regions, 100 temporary objects each
+        ->Unit(benchmark::kMillisecond)
+        ->Name("RegionAllocations")->MeasureProcessCPUTime()->Iterations(10);
+
+BENCHMARK(MarkThroughput)
+        ->Arg(100000) // 100000 live objects
+        ->Arg(1000000) // 1000000 live objects
+        ->Unit(benchmark::kMillisecond)
+        ->Name("MarkThroughput")->UseManualTime();
+
+BENCHMARK_MAIN();
\ No newline at end of file
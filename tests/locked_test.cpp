@@ -0,0 +1,67 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+#include "gc.h"
+
+class LockedTest : public ::testing::Test {
+protected:
+    static constexpr size_t YOUNG_THRESHOLD = 256 * 1024; // 256 KB
+    static constexpr size_t OLD_THRESHOLD = 1024 * 1024; // 1024 KB
+    static constexpr double YOUNG_RATIO = 0.6;
+    static constexpr double OLD_RATIO = 0.8;
+    static constexpr int THREAD_COUNT = 4;
+
+    void SetUp() override {
+        configure_thresholds(YOUNG_THRESHOLD, OLD_THRESHOLD, YOUNG_RATIO, OLD_RATIO);
+    }
+
+    // Allocates garbage between linked children, so that every thread keeps filling the young
+    // generation and collections run on whichever threads see it full. Children are linked at
+    // allocation: another thread's collection may run before a later change_parent would.
+    static void AllocationWorker(void *root, int child_count, std::vector<WeakRef *> &refs) {
+        for (int i = 0; i < child_count; i++) {
+            gc_malloc(1024, false, nullptr);
+            void *child = gc_malloc(1024, false, root);
+            refs.push_back(gc_weak_ref_create(child));
+        }
+    }
+};
+
+TEST_F(LockedTest, ConcurrentAllocationsCollectInline) {
+    const int child_count = 2048;
+    size_t initial_count = get_collections_count();
+
+    std::vector<void *> roots;
+    std::vector<std::vector<WeakRef *>> refs(THREAD_COUNT);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        roots.push_back(gc_malloc(64, true, nullptr));
+    }
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        threads.emplace_back(AllocationWorker, roots[i], child_count, std::ref(refs[i]));
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+
+    ASSERT_GT(get_collections_count(), initial_count);
+    gc_collect(true);
+    for (const auto &thread_refs: refs) {
+        for (WeakRef *ref: thread_refs) {
+            ASSERT_NE(gc_weak_ref_get(ref), nullptr);
+        }
+    }
+    ASSERT_GE(get_old_gen_size(), THREAD_COUNT * (64 + child_count * 1024));
+
+    for (void *root: roots) {
+        gc_free(root);
+    }
+    gc_collect(true);
+    ASSERT_EQ(get_old_gen_size() + get_young_gen_size(), 0);
+    for (const auto &thread_refs: refs) {
+        for (WeakRef *ref: thread_refs) {
+            ASSERT_EQ(gc_weak_ref_get(ref), nullptr);
+            gc_weak_ref_free(ref);
+        }
+    }
+}
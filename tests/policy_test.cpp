@@ -0,0 +1,38 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "gc_impl.h"
+
+// Policies that no library selects by default, driven through the collector template directly.
+
+TEST(MinimalPolicyTest, CollectsWithoutStatistics) {
+    GenerationalGC<MinimalPolicy> gc;
+    gc.ConfigureThresholds(1024 * 1024, 4 * 1024 * 1024, 0.6, 0.8);
+
+    void *root = gc.Malloc(64, true, nullptr);
+    std::vector<void *> children;
+    for (int i = 0; i < 256; i++) {
+        children.push_back(gc.Malloc(1024, false, root));
+    }
+    for (int i = 0; i < 1024; i++) {
+        gc.Malloc(1024, false, nullptr);
+    }
+    ASSERT_GT(gc.GetCollectionsCount(), 0);
+    ASSERT_GE(gc.GetOldGenSize() + gc.GetYoungGenSize(), 64 + 256 * 1024);
+
+    WeakRef *child_ref = gc.CreateWeakRef(children.back());
+    gc.ForceGarbageCollection(false);
+    gc.ForceGarbageCollection(true);
+    ASSERT_EQ(gc.GetWeakRef(child_ref), children.back());
+    ASSERT_EQ(gc.GetOldGenSize() + gc.GetYoungGenSize(), 64 + 256 * 1024);
+
+    ASSERT_EQ(gc.GetLastMarkMs(), 0.0);
+    ASSERT_EQ(gc.GetLastMinorPauseMs(), 0.0);
+    ASSERT_EQ(gc.GetYoungGenSurvivalRate(), 0.0);
+    ASSERT_EQ(gc.GetAllocationRate(), 0.0);
+
+    gc.Free(root);
+    gc.ForceGarbageCollection(true);
+    ASSERT_EQ(gc.GetWeakRef(child_ref), nullptr);
+    ASSERT_EQ(gc.GetOldGenSize() + gc.GetYoungGenSize(), 0);
+    gc.FreeWeakRef(child_ref);
+}
@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "gc.h"
+
+class SingleThreadedTest : public ::testing::Test {
+protected:
+    static constexpr size_t YOUNG_THRESHOLD = 1024 * 1024; // 1024 KB
+    static constexpr size_t OLD_THRESHOLD = 4 * 1024 * 1024; // 4096 KB
+    static constexpr double YOUNG_RATIO = 0.6;
+    static constexpr double OLD_RATIO = 0.8;
+
+    void SetUp() override {
+        configure_thresholds(YOUNG_THRESHOLD, OLD_THRESHOLD, YOUNG_RATIO, OLD_RATIO);
+    }
+};
+
+TEST_F(SingleThreadedTest, AllocationTriggersCollection) {
+    size_t initial_count = get_collections_count();
+
+    for (int i = 0; i < 1024; i++) {
+        gc_malloc(1024, false, nullptr);
+    }
+
+    ASSERT_GT(get_collections_count(), initial_count);
+    ASSERT_LT(get_young_gen_size(), YOUNG_RATIO * YOUNG_THRESHOLD);
+}
+
+TEST_F(SingleThreadedTest, LiveObjectsArePromoted) {
+    void *root = gc_malloc(64, true, nullptr);
+    std::vector<void *> children;
+    for (int i = 0; i < 1024; i++) {
+        children.push_back(gc_malloc(1024, false, root));
+    }
+
+    ASSERT_GE(get_old_gen_size() + get_young_gen_size(), 64 + 1024 * 1024);
+    ASSERT_GT(get_old_gen_size(), 0);
+    gc_collect(true);
+    ASSERT_GT(get_last_mark_ms(), 0.0);
+
+    gc_free(root);
+    gc_collect(true);
+    ASSERT_EQ(get_old_gen_size() + get_young_gen_size(), 0);
+}
+
+TEST_F(SingleThreadedTest, ObjectReturnedByCollectingAllocationSurvives) {
+    void *root = gc_malloc(64, true, nullptr);
+    size_t initial_count = get_collections_count();
+    void *ptr = nullptr;
+    while (get_collections_count() == initial_count) {
+        ptr = gc_malloc(1024, false, nullptr);
+    }
+
+    WeakRef *ref = gc_weak_ref_create(ptr);
+    ASSERT_EQ(gc_weak_ref_get(ref), ptr);
+    change_parent(ptr, root);
+    gc_collect(true);
+    ASSERT_EQ(gc_weak_ref_get(ref), ptr);
+
+    gc_weak_ref_free(ref);
+    gc_free(root);
+    gc_collect(true);
+}
+
+TEST_F(SingleThreadedTest, AsyncCollectionCompletesInline) {
+    WeakRef *ref = gc_weak_ref_create(gc_malloc(64, false, nullptr));
+    size_t ticket = gc_collect_async(true);
+
+    ASSERT_TRUE(gc_collect_done(ticket));
+    gc_collect_wait(ticket);
+    ASSERT_EQ(gc_weak_ref_get(ref), nullptr);
+
+    gc_weak_ref_free(ref);
+}
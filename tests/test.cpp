@@ -5,6 +5,10 @@
 #include <chrono>
 #include <iostream>
 #include <thread>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <unistd.h>
 #include "gc.h"
 
 size_t YOUNG_THRESHOLD = 1024 * 1024; // 1024 KB
@@ -149,6 +153,592 @@ TEST_F(GCBasicTest, BasicCyclicReference) {
     ASSERT_EQ(get_old_gen_size() + get_young_gen_size(), initial_size);
 }
 
+// Moving children out of a wide parent reorders its edge list; the children left behind must
+// stay linked to it.
+TEST_F(GCBasicTest, ChangeParentOnWideParent) {
+    const int child_count = 1000;
+    void *first = gc_malloc(64, true, nullptr);
+    void *second = gc_malloc(64, true, nullptr);
+    std::vector<WeakRef *> refs;
+    for (int i = 0; i < child_count; i++) {
+        refs.push_back(gc_weak_ref_create(gc_malloc(64, false, first)));
+    }
+    for (int i = 0; i < child_count; i += 3) {
+        change_parent(gc_weak_ref_get(refs[i]), second);
+    }
+
+    gc_collect(true);
+    for (WeakRef *ref: refs) {
+        ASSERT_NE(gc_weak_ref_get(ref), nullptr);
+    }
+
+    gc_free(first);
+    gc_collect(true);
+    for (int i = 0; i < child_count; i++) {
+        ASSERT_EQ(gc_weak_ref_get(refs[i]) != nullptr, i % 3 == 0);
+        gc_weak_ref_free(refs[i]);
+    }
+    gc_free(second);
+}
+
+// Large enough for the mark queue to drop its dequeued prefix partway through marking.
+TEST_F(GCBasicTest, MarkingLargeGraphKeepsReachableObjects) {
+    const int width = 200;
+    const int depth = 100;
+    gc_collect(true);
+    size_t live_before = get_old_gen_size() + get_young_gen_size();
+
+    void *root = gc_malloc(64, true, nullptr);
+    std::vector<WeakRef *> leaves;
+    for (int i = 0; i < width; i++) {
+        void *node = gc_malloc(16, false, root);
+        for (int j = 0; j < depth; j++) {
+            gc_malloc(16, false, node);
+        }
+        leaves.push_back(gc_weak_ref_create(gc_malloc(16, false, node)));
+    }
+    size_t graph_size = 64 + static_cast<size_t>(width) * (depth + 2) * 16;
+
+    gc_collect(false);
+    gc_collect(true);
+    gc_collect(true);
+    ASSERT_EQ(get_old_gen_size() + get_young_gen_size(), live_before + graph_size);
+    for (WeakRef *ref: leaves) {
+        ASSERT_NE(gc_weak_ref_get(ref), nullptr);
+    }
+
+    gc_free(root);
+    gc_collect(true);
+    ASSERT_EQ(get_old_gen_size() + get_young_gen_size(), live_before);
+    for (WeakRef *ref: leaves) {
+        ASSERT_EQ(gc_weak_ref_get(ref), nullptr);
+        gc_weak_ref_free(ref);
+    }
+}
+
+TEST_F(GCBasicTest, AdaptiveYoungGenSizing) {
+    const size_t min_threshold = 256 * 1024;
+    const size_t max_threshold = 2 * 1024 * 1024;
+
+    // Any measurable pause is over a zero budget, so the nursery shrinks to its lower bound.
+    configure_adaptive_young_gen(true, min_threshold, max_threshold, 0.0, 1.0);
+    for (int cycle = 0; cycle < 10; cycle++) {
+        for (int i = 0; i < 100; i++) {
+            gc_malloc(1024, false, nullptr);
+        }
+        gc_collect(false);
+        ASSERT_GE(get_young_gen_threshold(), min_threshold);
+        ASSERT_LE(get_young_gen_threshold(), max_threshold);
+    }
+    ASSERT_EQ(get_young_gen_threshold(), min_threshold);
+    ASSERT_LE(get_young_gen_survival_rate(), 1.0);
+    ASSERT_GE(get_last_minor_pause_ms(), 0.0);
+
+    // Any time spent in GC is over a zero CPU budget, so the nursery grows to its upper bound.
+    configure_adaptive_young_gen(true, min_threshold, max_threshold, 1000.0, 0.0);
+    for (int cycle = 0; cycle < 10; cycle++) {
+        for (int i = 0; i < 100; i++) {
+            gc_malloc(1024, false, nullptr);
+        }
+        gc_collect(false);
+    }
+    ASSERT_EQ(get_young_gen_threshold(), max_threshold);
+
+    configure_adaptive_young_gen(false, min_threshold, max_threshold, 5.0, 0.05);
+}
+
+TEST_F(GCBasicTest, WeakReferences) {
+    void *root = gc_malloc(64, true, nullptr);
+    void *child = gc_malloc(64, false, root);
+    void *garbage = gc_malloc(64, false, nullptr);
+
+    WeakRef *child_ref = gc_weak_ref_create(child);
+    WeakRef *garbage_ref = gc_weak_ref_create(garbage);
+    ASSERT_EQ(gc_weak_ref_get(garbage_ref), garbage);
+
+    gc_collect(true);
+
+    ASSERT_EQ(gc_weak_ref_get(child_ref), child);
+    ASSERT_EQ(gc_weak_ref_get(garbage_ref), nullptr);
+
+    gc_free(root);
+    gc_collect(true);
+
+    ASSERT_EQ(gc_weak_ref_get(child_ref), nullptr);
+
+    gc_weak_ref_free(child_ref);
+    gc_weak_ref_free(garbage_ref);
+}
+
+TEST_F(GCBasicTest, WeakMapEphemerons) {
+    WeakMap *cache = gc_weak_map_create();
+
+    void *key = gc_malloc(64, true, nullptr);
+    void *value = gc_malloc(1024, false, nullptr);
+    gc_weak_map_set(cache, key, value);
+
+    // A value that only references its own key must not keep the entry alive.
+    void *cyclic_key = gc_malloc(64, false, nullptr);
+    void *cyclic_value = gc_malloc(64, false, nullptr);
+    change_parent(cyclic_key, cyclic_value);
+    gc_weak_map_set(cache, cyclic_key, cyclic_value);
+
+    WeakRef *value_ref = gc_weak_ref_create(value);
+
+    gc_collect(false);
+    gc_collect(true);
+
+    ASSERT_EQ(gc_weak_map_size(cache), 1);
+    ASSERT_EQ(gc_weak_map_get(cache, key), value);
+    ASSERT_EQ(gc_weak_ref_get(value_ref), value);
+
+    gc_free(key);
+    gc_collect(true);
+
+    ASSERT_EQ(gc_weak_map_size(cache), 0);
+    ASSERT_EQ(gc_weak_map_get(cache, key), nullptr);
+    ASSERT_EQ(gc_weak_ref_get(value_ref), nullptr);
+
+    gc_weak_ref_free(value_ref);
+    gc_weak_map_free(cache);
+}
+
+// A minor collection only has to look at weak entries that involve young objects, however
+// large the tables holding old ones are.
+TEST_F(GCBasicTest, MinorCollectionSkipsOldWeakEntries) {
+    const int entry_count = 200000;
+    WeakMap *cache = gc_weak_map_create();
+    void *holder = gc_malloc(64, true, nullptr);
+    std::vector<WeakRef *> old_refs;
+    for (int i = 0; i < entry_count; i++) {
+        void *key = gc_malloc(8, false, holder);
+        gc_weak_map_set(cache, key, gc_malloc(8, false, key));
+        if (i % 100 == 0) {
+            old_refs.push_back(gc_weak_ref_create(key));
+        }
+    }
+    gc_collect(true);
+
+    void *young_key = gc_malloc(8, false, nullptr);
+    gc_weak_map_set(cache, young_key, gc_malloc(8, false, nullptr));
+    WeakRef *young_ref = gc_weak_ref_create(young_key);
+
+    auto start = std::chrono::steady_clock::now();
+    gc_collect(false);
+    double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    ASSERT_EQ(gc_weak_ref_get(young_ref), nullptr);
+    ASSERT_EQ(gc_weak_map_size(cache), entry_count);
+    for (WeakRef *ref: old_refs) {
+        ASSERT_NE(gc_weak_ref_get(ref), nullptr);
+        gc_weak_ref_free(ref);
+    }
+    ASSERT_LT(elapsed_ms, 50.0);
+
+    gc_weak_ref_free(young_ref);
+    gc_weak_map_free(cache);
+    gc_free(holder);
+    gc_collect(true);
+}
+
+TEST_F(GCBasicTest, RegionBulkReclamation) {
+    gc_collect(true);
+    void *outside_root = gc_malloc(64, true, nullptr);
+    size_t initial_size = get_old_gen_size() + get_young_gen_size();
+
+    WeakRef *temp_ref;
+    void *escaped_root;
+    void *escaped_child;
+    void *linked;
+    {
+        GCRegionScope scope;
+        void *temp = gc_malloc(1024, false, nullptr);
+        gc_malloc(1024, false, temp);
+        temp_ref = gc_weak_ref_create(temp);
+
+        escaped_root = gc_malloc(128, true, nullptr);
+        escaped_child = gc_malloc(256, false, escaped_root);
+        linked = gc_malloc(512, false, nullptr);
+        change_parent(linked, outside_root);
+        *static_cast<int *>(escaped_child) = 42;
+
+        ASSERT_EQ(get_old_gen_size() + get_young_gen_size(), initial_size);
+        gc_collect(true);
+        ASSERT_EQ(gc_weak_ref_get(temp_ref), temp);
+    }
+
+    ASSERT_EQ(gc_weak_ref_get(temp_ref), nullptr);
+    ASSERT_EQ(get_old_gen_size() + get_young_gen_size(), initial_size + 128 + 256 + 512);
+
+    gc_collect(true);
+    ASSERT_EQ(get_old_gen_size() + get_young_gen_size(), initial_size + 128 + 256 + 512);
+    ASSERT_EQ(*static_cast<int *>(escaped_child), 42);
+
+    gc_free(escaped_root);
+    gc_free(outside_root);
+    gc_collect(true);
+    ASSERT_EQ(get_old_gen_size() + get_young_gen_size(), initial_size - 64);
+
+    gc_weak_ref_free(temp_ref);
+}
+
+// Ending a region only looks at the weak entries that involve its own objects, however large the
+// tables holding everything else are.
+TEST_F(GCBasicTest, RegionEndSkipsUnrelatedWeakEntries) {
+    const int entry_count = 100000;
+    const int regions = 100;
+    WeakMap *cache = gc_weak_map_create();
+    void *holder = gc_malloc(64, true, nullptr);
+    std::vector<WeakRef *> refs;
+    for (int i = 0; i < entry_count; i++) {
+        void *key = gc_malloc(8, false, holder);
+        gc_weak_map_set(cache, key, gc_malloc(8, false, key));
+        if (i % 100 == 0) {
+            refs.push_back(gc_weak_ref_create(key));
+        }
+    }
+    gc_collect(true);
+
+    WeakMap *scoped = gc_weak_map_create();
+    std::vector<void *> outside_keys;
+    for (int i = 0; i < regions; i++) {
+        outside_keys.push_back(gc_malloc(8, false, holder));
+    }
+    std::vector<WeakRef *> dropped_refs;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < regions; i++) {
+        GCRegionScope scope;
+        void *key = gc_malloc(8, false, nullptr);
+        gc_weak_map_set(scoped, key, gc_malloc(8, false, nullptr));
+        gc_weak_map_set(scoped, outside_keys[i], gc_malloc(8, false, nullptr));
+        dropped_refs.push_back(gc_weak_ref_create(key));
+    }
+    double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    ASSERT_EQ(gc_weak_map_size(scoped), regions);
+    for (void *key: outside_keys) {
+        ASSERT_NE(gc_weak_map_get(scoped, key), nullptr);
+    }
+    for (WeakRef *ref: dropped_refs) {
+        ASSERT_EQ(gc_weak_ref_get(ref), nullptr);
+        gc_weak_ref_free(ref);
+    }
+    ASSERT_EQ(gc_weak_map_size(cache), entry_count);
+    // Scanning the cache at every region end takes seconds; the margin is for a periodic
+    // collection of the cache that may run concurrently.
+    ASSERT_LT(elapsed_ms, 500.0);
+
+    for (WeakRef *ref: refs) {
+        gc_weak_ref_free(ref);
+    }
+    gc_weak_map_free(scoped);
+    gc_weak_map_free(cache);
+    gc_free(holder);
+    gc_collect(true);
+}
+
+TEST_F(GCBasicTest, NestedRegions) {
+    WeakRef *inner_ref;
+    {
+        GCRegionScope outer;
+        void *outer_obj = gc_malloc(64, false, nullptr);
+        {
+            GCRegionScope inner;
+            void *inner_obj = gc_malloc(64, false, outer_obj);
+            inner_ref = gc_weak_ref_create(inner_obj);
+        }
+        ASSERT_NE(gc_weak_ref_get(inner_ref), nullptr);
+    }
+    ASSERT_EQ(gc_weak_ref_get(inner_ref), nullptr);
+
+    gc_weak_ref_free(inner_ref);
+}
+
+struct SnapshotNode {
+    uint64_t marker;
+    void *child;
+};
+
+TEST_F(GCBasicTest, SnapshotSaveAndLoad) {
+    const uint64_t marker = 0x5a5a5a5a5a5a5a5a;
+    std::string path = (std::filesystem::temp_directory_path() / "gc_snapshot_test.bin").string();
+
+    void *root_ptr = gc_malloc(sizeof(SnapshotNode), true, nullptr);
+    void *child_ptr = gc_malloc(sizeof(SnapshotNode), false, root_ptr);
+    auto *root = new(root_ptr) SnapshotNode{marker, child_ptr};
+    new(child_ptr) SnapshotNode{marker + 1, nullptr};
+    gc_collect(true);
+
+    ASSERT_TRUE(gc_snapshot_save(path.c_str()));
+    ASSERT_FALSE(std::filesystem::exists(path + ".tmp"));
+    // A save that cannot be completed leaves the previous file alone.
+    auto saved_size = std::filesystem::file_size(path);
+    std::filesystem::create_directory(path + ".tmp");
+    ASSERT_FALSE(gc_snapshot_save(path.c_str()));
+    std::filesystem::remove(path + ".tmp");
+    ASSERT_EQ(std::filesystem::file_size(path), saved_size);
+    size_t snapshot_before = get_snapshot_size();
+    ASSERT_TRUE(gc_snapshot_load(path.c_str()));
+    ASSERT_GE(get_snapshot_size(), snapshot_before + 2 * sizeof(SnapshotNode));
+    ASSERT_FALSE(gc_snapshot_load((path + ".missing").c_str()));
+
+    std::vector<void *> roots(gc_snapshot_roots(nullptr, 0));
+    gc_snapshot_roots(roots.data(), roots.size());
+    SnapshotNode *loaded = nullptr;
+    for (void *ptr: roots) {
+        auto *node = static_cast<SnapshotNode *>(ptr);
+        if (node->marker == marker && node != root) {
+            loaded = node;
+        }
+    }
+    ASSERT_NE(loaded, nullptr);
+    ASSERT_NE(loaded->child, child_ptr);
+    ASSERT_EQ(static_cast<SnapshotNode *>(loaded->child)->marker, marker + 1);
+
+    // Snapshot objects stay live on their own and keep their new children alive.
+    WeakRef *loaded_child = gc_weak_ref_create(loaded->child);
+    WeakRef *new_child = gc_weak_ref_create(gc_malloc(64, false, loaded->child));
+    gc_free(loaded);
+    gc_collect(false);
+    gc_collect(true);
+    ASSERT_NE(gc_weak_ref_get(loaded_child), nullptr);
+    ASSERT_NE(gc_weak_ref_get(new_child), nullptr);
+
+    gc_weak_ref_free(loaded_child);
+    gc_weak_ref_free(new_child);
+    gc_free(root_ptr);
+    std::filesystem::remove(path);
+}
+
+TEST_F(GCBasicTest, SnapshotLoadRejectsCorruptOffsets) {
+    std::string path = (std::filesystem::temp_directory_path() / "gc_snapshot_corrupt.bin").string();
+    // Header: magic, object, edge, relocation and payload word counts. One object record: payload
+    // offset, size, parent, edges offset, edges count, root flag. Then one payload word.
+    // The offset wraps around to 1 once the object's two payload words are added to it.
+    uint64_t words[] = {0, 1, 0, 0, 1,
+                        UINT64_MAX, 8, UINT64_MAX, 0, 0, 1,
+                        0};
+    std::memcpy(words, "GCSNAP01", 8);
+    std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char *>(words), sizeof(words));
+
+    size_t snapshot_before = get_snapshot_size();
+    ASSERT_FALSE(gc_snapshot_load(path.c_str()));
+    ASSERT_EQ(get_snapshot_size(), snapshot_before);
+    std::filesystem::remove(path);
+}
+
+static size_t ResidentBytes() {
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0;
+    size_t resident = 0;
+    statm >> pages >> resident;
+    return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+// Every round allocates larger objects than the last, so freed memory is only reusable once
+// neighbouring blocks are merged and split again.
+TEST_F(GCBasicTest, FreedMemoryIsReusedAcrossSizes) {
+    const int rounds = 16;
+    const int objects_per_round = 2000;
+    gc_collect(true);
+    size_t live_before = get_old_gen_size() + get_young_gen_size();
+    size_t resident_before = ResidentBytes();
+
+    for (int round = 0; round < rounds; round++) {
+        std::vector<void *> objects;
+        for (int i = 0; i < objects_per_round; i++) {
+            objects.push_back(gc_malloc(1024 + round * 1024 + (i % 16) * 8, true, nullptr));
+        }
+        for (void *ptr: objects) {
+            gc_free(ptr);
+        }
+        gc_collect(true);
+    }
+
+    // Without reuse the rounds would add up to about 270 MB, the largest one alone is 32 MB.
+    ASSERT_EQ(get_old_gen_size() + get_young_gen_size(), live_before);
+    ASSERT_LT(ResidentBytes(), resident_before + 128 * 1024 * 1024);
+}
+
+// Each region fills a whole chunk with garbage next to one root. Were the root carved from the
+// chunk, every region would leave 64 KB behind, about 128 MB in all.
+TEST_F(GCBasicTest, EscapedRegionRootsDoNotRetainChunks) {
+    const int regions = 2000;
+    gc_collect(true);
+    size_t resident_before = ResidentBytes();
+
+    std::vector<void *> roots;
+    for (int i = 0; i < regions; i++) {
+        GCRegionScope scope;
+        roots.push_back(gc_malloc(64, true, nullptr));
+        for (int j = 0; j < 100; j++) {
+            gc_malloc(512, false, nullptr);
+        }
+    }
+    ASSERT_LT(ResidentBytes(), resident_before + 32 * 1024 * 1024);
+
+    for (void *root: roots) {
+        gc_free(root);
+    }
+    gc_collect(true);
+}
+
+TEST_F(GCBasicTest, AsyncCollection) {
+    WeakRef *garbage_ref = gc_weak_ref_create(gc_malloc(64, false, nullptr));
+    size_t initial_count = get_collections_count();
+
+    size_t minor_ticket = gc_collect_async(false);
+    size_t major_ticket = gc_collect_async(true);
+    ASSERT_GE(major_ticket, minor_ticket);
+    ASSERT_LE(major_ticket, minor_ticket + 1);
+
+    gc_collect_wait(major_ticket);
+    ASSERT_TRUE(gc_collect_done(minor_ticket));
+    ASSERT_TRUE(gc_collect_done(major_ticket));
+    ASSERT_GT(get_collections_count(), initial_count);
+    ASSERT_EQ(gc_weak_ref_get(garbage_ref), nullptr);
+
+    // A request made while collections keep running is served by a cycle that starts after it.
+    std::vector<std::thread> requesters;
+    for (int i = 0; i < 4; i++) {
+        requesters.emplace_back([] {
+            for (int j = 0; j < 10; j++) {
+                WeakRef *ref = gc_weak_ref_create(gc_malloc(64, false, nullptr));
+                gc_collect_wait(gc_collect_async(true));
+                ASSERT_EQ(gc_weak_ref_get(ref), nullptr);
+                gc_weak_ref_free(ref);
+            }
+        });
+    }
+    for (auto &thread: requesters) {
+        thread.join();
+    }
+
+    gc_weak_ref_free(garbage_ref);
+}
+
+class MemoryPressureTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        configure_thresholds(YOUNG_THRESHOLD, OLD_THRESHOLD, YOUNG_RATIO, OLD_RATIO);
+        cgroup_dir = std::filesystem::temp_directory_path() / ("gc_fake_cgroup_" + std::to_string(getpid()));
+        std::filesystem::create_directories(cgroup_dir);
+    }
+
+    void TearDown() override {
+        configure_memory_pressure(nullptr, 0, 0.0);
+        std::filesystem::remove_all(cgroup_dir);
+    }
+
+    void WriteCgroup(const std::string &max, size_t current, double some_avg10) {
+        std::ofstream(cgroup_dir / "memory.max") << max << "\n";
+        std::ofstream(cgroup_dir / "memory.current") << current << "\n";
+        std::ofstream(cgroup_dir / "memory.pressure")
+                << "some avg10=" << some_avg10 << " avg60=0.00 avg300=0.00 total=0\n"
+                << "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n";
+    }
+
+    std::filesystem::path cgroup_dir;
+};
+
+TEST_F(MemoryPressureTest, LowHeadroomTriggersCollection) {
+    const size_t min_headroom = 64 * 1024 * 1024;
+    WriteCgroup("1073741824", 1073741824 - 1024 * 1024, 0.0);
+    configure_memory_pressure(cgroup_dir.c_str(), min_headroom, 0.0);
+
+    size_t initial_pressure = get_memory_pressure_collections();
+    size_t initial_collections = get_collections_count();
+    std::this_thread::sleep_for(std::chrono::milliseconds(2000));
+
+    ASSERT_EQ(get_memory_headroom(), 1024 * 1024);
+    ASSERT_GT(get_memory_pressure_collections(), initial_pressure);
+    ASSERT_GT(get_collections_count(), initial_collections);
+
+    WriteCgroup("max", 1024 * 1024, 0.0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    size_t relieved_pressure = get_memory_pressure_collections();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+
+    ASSERT_EQ(get_memory_pressure_collections(), relieved_pressure);
+    ASSERT_EQ(get_memory_headroom(), SIZE_MAX);
+}
+
+TEST_F(MemoryPressureTest, LowHeadroomTightensThresholds) {
+    size_t threshold = get_young_gen_threshold();
+    WriteCgroup("1073741824", 1073741824 - 1024 * 1024, 0.0);
+    configure_memory_pressure(cgroup_dir.c_str(), 64 * 1024 * 1024, 0.0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+
+    ASSERT_LE(get_young_gen_threshold(), threshold / 2);
+
+    // Tightened thresholds make allocations wake the collector before the next tick.
+    size_t initial_collections = get_collections_count();
+    for (size_t allocated = 0; allocated < threshold; allocated += 1024) {
+        gc_malloc(1024, false, nullptr);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    ASSERT_GT(get_collections_count(), initial_collections);
+
+    WriteCgroup("max", 1024 * 1024, 0.0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    ASSERT_LT(get_young_gen_threshold(), threshold);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (get_young_gen_threshold() < threshold && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    ASSERT_EQ(get_young_gen_threshold(), threshold);
+}
+
+// Headroom that stays low while the heap does not grow only warrants one collection; the next
+// one waits for the heap to grow.
+TEST_F(MemoryPressureTest, SteadyLowHeadroomBacksOff) {
+    WriteCgroup("1073741824", 1073741824 - 1024 * 1024, 0.0);
+    size_t initial_pressure = get_memory_pressure_collections();
+    configure_memory_pressure(cgroup_dir.c_str(), 64 * 1024 * 1024, 0.0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5500));
+    ASSERT_EQ(get_memory_pressure_collections(), initial_pressure + 1);
+
+    std::vector<void *> objects;
+    for (int i = 0; i < 64; i++) {
+        objects.push_back(gc_malloc(16 * 1024, true, nullptr));
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (get_memory_pressure_collections() == initial_pressure + 1 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    ASSERT_EQ(get_memory_pressure_collections(), initial_pressure + 2);
+
+    for (void *ptr: objects) {
+        gc_free(ptr);
+    }
+}
+
+// A steady stream of requested collections must not keep the cgroup from being checked.
+TEST_F(MemoryPressureTest, RequestedCollectionsDoNotStarvePressureChecks) {
+    WriteCgroup("1073741824", 1073741824 - 1024 * 1024, 0.0);
+    size_t initial_pressure = get_memory_pressure_collections();
+    configure_memory_pressure(cgroup_dir.c_str(), 64 * 1024 * 1024, 0.0);
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(2500);
+    while (std::chrono::steady_clock::now() < deadline) {
+        gc_collect_async(false);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    ASSERT_EQ(get_memory_headroom(), 1024 * 1024);
+    ASSERT_GT(get_memory_pressure_collections(), initial_pressure);
+}
+
+TEST_F(MemoryPressureTest, StallsTriggerCollection) {
+    WriteCgroup("max", 1024 * 1024, 75.5);
+    configure_memory_pressure(cgroup_dir.c_str(), 0, 50.0);
+
+    size_t initial_pressure = get_memory_pressure_collections();
+    std::this_thread::sleep_for(std::chrono::milliseconds(2000));
+
+    ASSERT_GT(get_memory_pressure_collections(), initial_pressure);
+}
+
 class MultithreadTest : public ::testing::Test {
 protected:
     void SetUp() override {